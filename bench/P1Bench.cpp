@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replay of recorded telegrams through P1Reader (readTelegram/decodeTelegram), built by [env:native_bench].
+// Every heap allocation of the process is counted to follow the memory cost of the parser.
+//
+// A file can hold several telegrams (ex: /rawhistory of a module) : they are replayed in turn.
+// With -k, the telegrams are encrypted first as Smarty frames (AES-128-GCM) with this key and read through P1Decryptor :
+// the result is named <meter>-gcm. One telegram per second must stay far below 1 s on the module.
+//
+// Usage : program [-n iterations] [-o result.json] [-k key] telegram.txt...
+// Compare with the committed baseline : python3 bench/compare.py bench/baseline.json result.json
+
+#include <Arduino.h>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <unistd.h>
+#include "HAL.h"
+#include "P1Reader.h"
+
+// ---- Allocation tracking ----
+
+namespace
+{
+  struct AllocationStats
+  {
+    uint64_t count;
+    int64_t live;
+    int64_t peak;
+  } heap = {};
+
+  // size of the block stored just before it, keeps the alignment of malloc
+  const size_t HEADER = alignof(std::max_align_t);
+}
+
+void *operator new(size_t size)
+{
+  uint8_t *block = static_cast<uint8_t *>(malloc(size + HEADER));
+  if (block == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  *reinterpret_cast<size_t *>(block) = size;
+  heap.count++;
+  heap.live += size;
+  heap.peak = std::max(heap.peak, heap.live);
+  return block + HEADER;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  if (ptr != nullptr)
+  {
+    uint8_t *block = static_cast<uint8_t *>(ptr) - HEADER;
+    heap.live -= *reinterpret_cast<size_t *>(block);
+    free(block);
+  }
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+
+// ---- Firmware hooks (Main.cpp is not part of the benchmark) ----
+
+void MainSendDebug(const char *payload) { (void)payload; }
+void MainSendDebugPrintf(const char *format, ...) { (void)format; }
+void blink(int t, unsigned long speed) { (void)t; (void)speed; }
+
+// ---- Benchmark ----
+
+struct Result
+{
+  std::string name;
+  size_t bytes;
+  unsigned lines;
+  unsigned long iterations;
+  unsigned long decoded;
+  double nsPerTelegram;
+  double allocationsPerTelegram;
+  int64_t peakHeap;
+  size_t datagramBytes;
+};
+
+static bool loadFile(const char *path, std::string &content)
+{
+  FILE *fp = fopen(path, "rb");
+  if (fp == nullptr)
+  {
+    return false;
+  }
+  char buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    content.append(buffer, len);
+  }
+  fclose(fp);
+  return true;
+}
+
+static std::string meterName(const char *path)
+{
+  std::string name = path;
+  size_t slash = name.find_last_of('/');
+  if (slash != std::string::npos)
+  {
+    name = name.substr(slash + 1);
+  }
+  size_t dot = name.find_last_of('.');
+  return (dot != std::string::npos) ? name.substr(0, dot) : name;
+}
+
+/// @brief Cut the content of a file in telegrams, each one starts with a '/'
+/// @return position of the start of each telegram, followed by the end of the content
+static std::vector<size_t> splitTelegrams(const std::string &content)
+{
+  std::vector<size_t> starts = {0};
+  for (size_t next = content.find("\n/"); next != std::string::npos; next = content.find("\n/", next + 1))
+  {
+    starts.push_back(next + 1);
+  }
+  starts.push_back(content.size());
+  return starts;
+}
+
+/// @brief Encrypt each telegram as a Smarty frame : header, AES-128-GCM with a counter +1 per frame, tag of 12 bytes
+/// @param starts position of each telegram (see splitTelegrams), replaced by the position of each frame
+static std::string encryptTelegrams(const std::string &content, std::vector<size_t> &starts, const char *hexKey)
+{
+  static const uint8_t title[8] = {'S', 'A', 'G', 0x10, 0x00, 0x00, 0x00, 0x01};
+  static const uint8_t aad[17] = {0x30, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+  uint8_t key[P1KEYSIZE];
+  P1Decryptor::ParseKey(hexKey, key);
+  br_aes_small_ctr_keys aesKeys = {};
+  br_gcm_context gcm = {};
+  br_aes_small_ctr_init(&aesKeys, key, sizeof(key));
+  br_gcm_init(&gcm, &aesKeys.vtable, br_ghash_ctmul32);
+
+  std::string frames;
+  std::vector<size_t> frameStarts;
+  for (size_t t = 0; t + 1 < starts.size(); t++)
+  {
+    std::string data = content.substr(starts[t], starts[t + 1] - starts[t]);
+    uint32_t counter = t + 1;
+    size_t length = 5 + data.size() + P1FRAMETAG;
+    uint8_t header[P1FRAMEHEADER] = {0xDB, sizeof(title)};
+    memcpy(&header[2], title, sizeof(title));
+    header[10] = 0x82;
+    header[11] = length >> 8;
+    header[12] = length & 0xFF;
+    header[13] = 0x30;
+    for (uint8_t n = 0; n < 4; n++)
+    {
+      header[14 + n] = counter >> (24 - 8 * n);
+    }
+    uint8_t iv[12];
+    memcpy(iv, title, sizeof(title));
+    memcpy(&iv[8], &header[14], 4);
+
+    uint8_t tag[P1FRAMETAG];
+    br_gcm_reset(&gcm, iv, sizeof(iv));
+    br_gcm_aad_inject(&gcm, aad, sizeof(aad));
+    br_gcm_flip(&gcm);
+    br_gcm_run(&gcm, 1, &data[0], data.size());
+    br_gcm_get_tag_trunc(&gcm, tag, sizeof(tag));
+
+    frameStarts.push_back(frames.size());
+    frames.append(reinterpret_cast<const char *>(header), sizeof(header));
+    frames.append(data);
+    frames.append(reinterpret_cast<const char *>(tag), sizeof(tag));
+  }
+  frameStarts.push_back(frames.size());
+  starts = frameStarts;
+  return frames;
+}
+
+static Result replay(const char *path, const std::string &content, unsigned long iterations, const char *key)
+{
+  std::vector<size_t> starts = splitTelegrams(content);
+  const size_t telegrams = starts.size() - 1;
+  settings conf;
+  conf.interval = 10;
+  strcpy(conf.p1Key, key);
+  std::string frames = (key[0] != '\0') ? encryptTelegrams(content, starts, key) : content;
+  P1Reader reader(conf);
+  Result result = {};
+  std::vector<uint64_t> durations;
+  uint64_t allocations = 0;
+
+  result.name = meterName(path) + ((key[0] != '\0') ? "-gcm" : "");
+  // per telegram
+  result.bytes = content.size() / telegrams;
+  result.lines = std::count(content.begin(), content.end(), '\n') / telegrams;
+  result.iterations = iterations;
+  durations.reserve(iterations);
+
+  for (unsigned long i = 0; i < iterations; i++)
+  {
+    reader.ResetnextUpdateTime();
+    HAL::advanceMillis(1);
+    reader.DoMe(); // Data Request
+    size_t t = i % telegrams;
+    HAL::feedSerial(frames.data() + starts[t], starts[t + 1] - starts[t]);
+
+    uint64_t allocBefore = heap.count;
+    int64_t heapBefore = heap.live;
+    heap.peak = heap.live;
+    auto start = std::chrono::steady_clock::now();
+    reader.DoMe(); // readTelegram -> decodeTelegram
+    auto stop = std::chrono::steady_clock::now();
+
+    allocations += heap.count - allocBefore;
+    result.peakHeap = std::max(result.peakHeap, heap.peak - heapBefore);
+    durations.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    if (reader.dataEnd)
+    {
+      result.decoded++;
+      result.datagramBytes = reader.GetHistory().LastSize();
+    }
+  }
+
+  // median : less sensitive than the mean to the preemption of the benchmark by the host
+  std::nth_element(durations.begin(), durations.begin() + durations.size() / 2, durations.end());
+  result.nsPerTelegram = durations[durations.size() / 2];
+  result.allocationsPerTelegram = static_cast<double>(allocations) / iterations;
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long iterations = 1000;
+  const char *output = nullptr;
+  const char *key = "";
+  uint8_t unused[P1KEYSIZE];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:o:k:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      iterations = std::max(1UL, strtoul(optarg, nullptr, 10));
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'k':
+      key = optarg;
+      if (!P1Decryptor::ParseKey(key, unused))
+      {
+        fprintf(stderr, "The key must be 32 hexadecimal chars\n");
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n iterations] [-o result.json] [-k key] telegram.txt...\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    fprintf(stderr, "Usage: %s [-n iterations] [-o result.json] [-k key] telegram.txt...\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  for (int i = optind; i < argc; i++)
+  {
+    std::string telegram;
+    if (!loadFile(argv[i], telegram))
+    {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      return 1;
+    }
+    results.push_back(replay(argv[i], telegram, iterations, key));
+  }
+
+  FILE *out = (output != nullptr) ? fopen(output, "w") : stdout;
+  if (out == nullptr)
+  {
+    fprintf(stderr, "Cannot write %s\n", output);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"iterations\": %lu,\n  \"meters\": {", iterations);
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    fprintf(out, "%s\n    \"%s\": {\n", (i == 0) ? "" : ",", r.name.c_str());
+    fprintf(out, "      \"bytes\": %zu,\n", r.bytes);
+    fprintf(out, "      \"lines\": %u,\n", r.lines);
+    fprintf(out, "      \"decoded\": %lu,\n", r.decoded);
+    fprintf(out, "      \"ns_per_line\": %.1f,\n", r.nsPerTelegram / std::max(1U, r.lines));
+    fprintf(out, "      \"ns_per_telegram\": %.1f,\n", r.nsPerTelegram);
+    fprintf(out, "      \"allocations_per_telegram\": %.2f,\n", r.allocationsPerTelegram);
+    fprintf(out, "      \"peak_heap_bytes\": %lld,\n", static_cast<long long>(r.peakHeap));
+    fprintf(out, "      \"datagram_bytes\": %zu\n", r.datagramBytes);
+    fprintf(out, "    }");
+  }
+  fprintf(out, "\n  }\n}\n");
+
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,48 @@
+import json
+import sys
+
+# Compare a result of the P1 benchmark (native_bench) with the baseline
+# usage : python3 bench/compare.py bench/baseline.json result.json [tolerance %]
+
+# The memory figures do not depend on the host : any increase is a regression.
+# The timings do, a margin is allowed (re-generate the baseline when the host changes).
+EXACT_KEYS = ["decoded", "allocations_per_telegram", "peak_heap_bytes", "datagram_bytes"]
+TIMING_KEYS = ["ns_per_line", "ns_per_telegram"]
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage : compare.py baseline.json result.json [tolerance %]")
+        return 2
+
+    with open(sys.argv[1]) as f:
+        baselineDoc = json.load(f)
+    with open(sys.argv[2]) as f:
+        resultDoc = json.load(f)
+    baseline = baselineDoc["meters"]
+    result = resultDoc["meters"]
+    tolerance = float(sys.argv[3]) if len(sys.argv) > 3 else 25.0
+
+    regression = False
+    for meter, base in sorted(baseline.items()):
+        if meter not in result:
+            print("{:<10} missing in the result".format(meter))
+            regression = True
+            continue
+        current = result[meter]
+        for key in EXACT_KEYS + TIMING_KEYS:
+            limit = base[key] * (1 + tolerance / 100) if key in TIMING_KEYS else base[key]
+            if key == "decoded":
+                # every telegram must still be decoded, whatever the number of iterations
+                failed = current[key] * baselineDoc["iterations"] < base[key] * resultDoc["iterations"]
+            else:
+                failed = current[key] > limit
+            delta = ((current[key] - base[key]) * 100 / base[key]) if base[key] else 0
+            print("{:<10} {:<26} {:>12} -> {:>12} ({:+.1f}%){}".format(meter, key, base[key], current[key], delta, "  REGRESSION" if failed else ""))
+            regression |= failed
+
+    return 1 if regression else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
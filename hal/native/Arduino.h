@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host (Linux) replacement of the Arduino core, only used by [env:native]
+// Just enough of the ESP8266 API for the firmware sources to build unchanged.
+
+#ifndef HAL_NATIVE_ARDUINO_H
+#define HAL_NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define OUTPUT 0x01
+
+#ifndef LED_BUILTIN
+#define LED_BUILTIN 2
+#endif
+
+// Flash access : everything is in RAM on the host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+#define strcmp_P strcmp
+#define strncpy_P strncpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#define ADC_MODE(mode)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+char *dtostrf(double number, signed char width, unsigned char prec, char *s);
+
+/// @brief Arduino String on top of std::string
+class String
+{
+public:
+  String() = default;
+  String(const char *cstr) : str(cstr ? cstr : "") {}
+  String(const std::string &s) : str(s) {}
+  String(char c) : str(1, c) {}
+  explicit String(int value) : str(std::to_string(value)) {}
+  explicit String(unsigned int value) : str(std::to_string(value)) {}
+  explicit String(long value) : str(std::to_string(value)) {}
+  explicit String(unsigned long value) : str(std::to_string(value)) {}
+
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.size(); }
+  bool reserve(unsigned int size) { str.reserve(size); return true; }
+  char operator[](unsigned int index) const { return index < str.size() ? str[index] : 0; }
+
+  bool concat(const char *cstr) { str += (cstr ? cstr : ""); return true; }
+  bool concat(const char *cstr, unsigned int len) { str.append(cstr, len); return true; }
+  bool concat(char c) { str += c; return true; }
+  bool concat(const String &s) { str += s.str; return true; }
+  String &operator+=(const char *cstr) { concat(cstr); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+  String &operator+=(const String &s) { concat(s); return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+  friend String operator+(const String &a, const char *b) { return String(a.str + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.str); }
+
+  bool operator==(const String &s) const { return str == s.str; }
+  bool operator==(const char *cstr) const { return str == (cstr ? cstr : ""); }
+  bool operator!=(const String &s) const { return str != s.str; }
+  bool operator!=(const char *cstr) const { return !(*this == cstr); }
+
+  int indexOf(char c) const { return find(str.find(c)); }
+  int indexOf(const char *cstr) const { return find(str.find(cstr)); }
+  int lastIndexOf(const char *cstr) const { return find(str.rfind(cstr)); }
+  String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const { return from < str.size() ? String(str.substr(from, to - from)) : String(); }
+  long toInt() const { return atol(str.c_str()); }
+  float toFloat() const { return atof(str.c_str()); }
+  void toCharArray(char *buf, unsigned int size) const
+  {
+    if (size == 0)
+    {
+      return;
+    }
+    size_t len = std::min<size_t>(size - 1, str.size());
+    memcpy(buf, str.data(), len);
+    buf[len] = '\0';
+  }
+  void trim()
+  {
+    size_t start = str.find_first_not_of(" \t\r\n");
+    size_t end = str.find_last_not_of(" \t\r\n");
+    str = (start == std::string::npos) ? "" : str.substr(start, end - start + 1);
+  }
+
+private:
+  std::string str;
+  static int find(size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+};
+
+class Print
+{
+public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+    {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+  size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t *>(buffer), size); }
+  virtual int availableForWrite() { return 0; }
+  size_t print(const char *s) { return write(s, strlen(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int value) { return print(String(value)); }
+  size_t print(unsigned int value) { return print(String(value)); }
+  size_t print(long value) { return print(String(value)); }
+  size_t print(unsigned long value) { return print(String(value)); }
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return (len > 0) ? write(buffer, std::min<size_t>(len, sizeof(buffer) - 1)) : 0;
+  }
+  virtual void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  size_t readBytes(char *buffer, size_t length)
+  {
+    size_t count = 0;
+    while (count < length && available() > 0)
+    {
+      buffer[count++] = static_cast<char>(read());
+    }
+    return count;
+  }
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes(reinterpret_cast<char *>(buffer), length); }
+  size_t readBytesUntil(char terminator, char *buffer, size_t length)
+  {
+    size_t count = 0;
+    while (count < length && available() > 0)
+    {
+      char c = static_cast<char>(read());
+      if (c == terminator)
+      {
+        break;
+      }
+      buffer[count++] = c;
+    }
+    return count;
+  }
+  String readStringUntil(char terminator)
+  {
+    String result;
+    while (available() > 0)
+    {
+      char c = static_cast<char>(read());
+      if (c == terminator)
+      {
+        break;
+      }
+      result += c;
+    }
+    return result;
+  }
+  String readString()
+  {
+    String result;
+    while (available() > 0)
+    {
+      result += static_cast<char>(read());
+    }
+    return result;
+  }
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+/// @brief UART fed by the host (see HAL::feedSerial), output goes to stdout
+class HardwareSerial : public Stream
+{
+public:
+  using Print::write;
+  void begin(unsigned long baud) { (void)baud; }
+  size_t setRxBufferSize(size_t size) { return size; }
+  int available() override { return static_cast<int>(rx.size() - rxPos); }
+  int read() override { return (rxPos < rx.size()) ? static_cast<uint8_t>(rx[rxPos++]) : -1; }
+  int peek() override { return (rxPos < rx.size()) ? static_cast<uint8_t>(rx[rxPos]) : -1; }
+  size_t read(uint8_t *buffer, size_t size)
+  {
+    size_t len = std::min(size, rx.size() - rxPos);
+    memcpy(buffer, rx.data() + rxPos, len);
+    rxPos += len;
+    return len;
+  }
+  size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+  size_t write(const uint8_t *buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+  int availableForWrite() override { return 256; }
+  void flush() override { fflush(stdout); }
+
+  /// @brief Append bytes as if the meter sent them
+  void feed(const char *data, size_t len)
+  {
+    rx.erase(0, rxPos);
+    rxPos = 0;
+    rx.append(data, len);
+  }
+
+private:
+  std::string rx;
+  size_t rxPos = 0;
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+  uint32_t getFreeHeap();
+  uint32_t getFreeSketchSpace() { return 1024 * 1024; }
+  uint16_t getVcc() { return 3300; }
+  [[noreturn]] void reset();
+  [[noreturn]] void restart();
+};
+extern EspClass ESP;
+
+#endif
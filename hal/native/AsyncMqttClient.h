@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_ASYNCMQTTCLIENT_H
+#define HAL_NATIVE_ASYNCMQTTCLIENT_H
+
+#include <Arduino.h>
+#include "HAL.h"
+
+enum class AsyncMqttClientDisconnectReason : uint8_t
+{
+  TCP_DISCONNECTED = 0,
+  MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+  MQTT_IDENTIFIER_REJECTED = 2,
+  MQTT_SERVER_UNAVAILABLE = 3,
+  MQTT_MALFORMED_CREDENTIALS = 4,
+  MQTT_NOT_AUTHORIZED = 5,
+  ESP8266_NOT_ENOUGH_SPACE = 6,
+  TLS_BAD_FINGERPRINT = 7
+};
+
+/// @brief Broker simulated by the host : the connection succeeds if HAL::setNetworkUp(true),
+/// the events are raised on the next HAL::poll() like the asynchronous client does
+class AsyncMqttClient
+{
+public:
+  typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+  typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+
+  AsyncMqttClient &setServer(const char *host, uint16_t port) { (void)host; (void)port; return *this; }
+  AsyncMqttClient &setCredentials(const char *username, const char *password = nullptr) { (void)username; (void)password; return *this; }
+  AsyncMqttClient &setClientId(const char *clientId) { (void)clientId; return *this; }
+  AsyncMqttClient &setKeepAlive(uint16_t keepAlive) { (void)keepAlive; return *this; }
+  AsyncMqttClient &onConnect(OnConnectUserCallback callback) { connectCallback = callback; return *this; }
+  AsyncMqttClient &onDisconnect(OnDisconnectUserCallback callback) { disconnectCallback = callback; return *this; }
+
+  bool connected() const { return isConnected && HAL::isBrokerUp(); }
+  void connect();
+  void disconnect(bool force = false);
+  void clearQueue() {}
+  uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0, bool dup = false, uint16_t message_id = 0);
+
+private:
+  bool isConnected = false;
+  uint16_t lastPacketId = 0;
+  OnConnectUserCallback connectCallback;
+  OnDisconnectUserCallback disconnectCallback;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_EEPROM_H
+#define HAL_NATIVE_EEPROM_H
+
+#include <Arduino.h>
+
+/// @brief EEPROM emulated in RAM (content is lost at exit)
+class EEPROMClass
+{
+public:
+  void begin(size_t size)
+  {
+    if (data.size() < size)
+    {
+      data.resize(size, 0);
+    }
+  }
+
+  template <typename T>
+  T &get(int address, T &value)
+  {
+    begin(address + sizeof(T));
+    memcpy(reinterpret_cast<void *>(&value), &data[address], sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  const T &put(int address, const T &value)
+  {
+    begin(address + sizeof(T));
+    memcpy(&data[address], reinterpret_cast<const void *>(&value), sizeof(T));
+    return value;
+  }
+
+  bool commit() { return true; }
+
+private:
+  std::vector<uint8_t> data;
+};
+extern EEPROMClass EEPROM;
+
+#endif
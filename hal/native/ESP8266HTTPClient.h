@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_ESP8266HTTPCLIENT_H
+#define HAL_NATIVE_ESP8266HTTPCLIENT_H
+
+#include <Arduino.h>
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_FAILED (-1)
+
+/// @brief HTTP client of the host : nothing is sent, the request is only counted (and printed if verbose)
+class HTTPClient
+{
+public:
+  bool begin(WiFiClient &client, const String &url) { (void)client; currentUrl = url; return true; }
+  int GET();
+  void end() {}
+  static String errorToString(int error) { return String((error == HTTPC_ERROR_CONNECTION_FAILED) ? "connection failed" : "error"); }
+
+private:
+  String currentUrl;
+};
+
+#endif
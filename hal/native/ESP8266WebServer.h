@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_ESP8266WEBSERVER_H
+#define HAL_NATIVE_ESP8266WEBSERVER_H
+
+#include <Arduino.h>
+#include <map>
+#include "WiFiClient.h"
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define HTTP_UPLOAD_BUFLEN 2048
+#define U_FLASH 0
+
+enum HTTPMethod
+{
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST
+};
+
+enum HTTPUploadStatus
+{
+  UPLOAD_FILE_START,
+  UPLOAD_FILE_WRITE,
+  UPLOAD_FILE_END,
+  UPLOAD_FILE_ABORTED
+};
+
+struct HTTPUpload
+{
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  size_t contentLength;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+/// @brief OTA writer of the host : always refuses the update
+class UpdaterClass
+{
+public:
+  bool begin(size_t size, int command = U_FLASH) { (void)size; (void)command; return false; }
+  size_t write(uint8_t *data, size_t len) { (void)data; (void)len; return 0; }
+  bool end(bool evenIfRemaining = false) { (void)evenIfRemaining; return false; }
+  void clearError() {}
+  String getErrorString() { return String("Not supported on native"); }
+};
+extern UpdaterClass Update;
+
+/// @brief Web server of the host : no socket, the pages are requested with HAL::httpGet()
+class ESP8266WebServer
+{
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit ESP8266WebServer(int port);
+  ~ESP8266WebServer();
+  void begin() {}
+  void handleClient() {}
+  void on(const char *uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const char *uri, HTTPMethod method, THandlerFunction handler) { on(uri, method, handler, nullptr); }
+  void on(const char *uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler)
+  {
+    (void)method;
+    (void)uploadHandler;
+    handlers[uri] = handler;
+  }
+
+  void send(int code) { send(code, "text/plain", ""); }
+  void send(int code, const char *content_type) { send(code, content_type, ""); }
+  void send(int code, const char *content_type, const char *content);
+  void send(int code, const char *content_type, const String &content) { send(code, content_type, content.c_str()); }
+  void send(int code, const char *content_type, const char *content, size_t contentLength) { (void)code; (void)content_type; (void)content; replied += contentLength; }
+  void sendHeader(const char *name, const char *value) { (void)name; (void)value; }
+  void sendHeader(const char *name, const String &value) { sendHeader(name, value.c_str()); }
+  void sendContent(const char *content);
+  void sendContent(const String &content) { sendContent(content.c_str()); }
+  void setContentLength(size_t length) { (void)length; }
+
+  String arg(const char *name) { (void)name; return String(); }
+  bool hasArg(const char *name) { (void)name; return false; }
+  String header(const char *name) { (void)name; return String(); }
+  HTTPMethod method() { return HTTP_GET; }
+  bool authenticate(const char *user, const char *password) { (void)user; (void)password; return true; }
+  void requestAuthentication() { send(401); }
+  HTTPUpload &upload() { return currentUpload; }
+  WiFiClient &client() { return currentClient; }
+
+  /// @brief Call the handler of the page (used by HAL::httpGet)
+  /// @return number of bytes of the reply, -1 if the page is unknown
+  long request(const char *uri);
+
+private:
+  std::map<std::string, THandlerFunction> handlers;
+  HTTPUpload currentUpload = {};
+  WiFiClient currentClient;
+  long replied = 0;
+};
+
+#endif
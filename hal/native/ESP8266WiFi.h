@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_ESP8266WIFI_H
+#define HAL_NATIVE_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include "WiFiClient.h"
+
+typedef enum
+{
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum
+{
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum
+{
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2
+} WiFiSleepType_t;
+
+class IPAddress
+{
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{a, b, c, d} {}
+  String toString() const
+  {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buffer);
+  }
+
+private:
+  uint8_t bytes[4];
+};
+
+struct WiFiEventStationModeDisconnected
+{
+  String ssid;
+  uint8_t reason;
+};
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+/// @brief WiFi of the host : connected as soon as asked if HAL::setNetworkUp(true)
+class ESP8266WiFiClass
+{
+public:
+  void persistent(bool) {}
+  void setAutoConnect(bool) {}
+  void setAutoReconnect(bool) {}
+  void setSleepMode(WiFiSleepType_t) {}
+  void setOutputPower(float) {}
+  bool mode(WiFiMode_t m) { currentMode = m; return true; }
+  WiFiMode_t getMode() { return currentMode; }
+  wl_status_t begin(const char *ssid, const char *passphrase);
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  bool softAP(const char *ssid, const char *passphrase) { (void)ssid; (void)passphrase; return true; }
+  IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  String macAddress() { return String("02:00:00:00:00:01"); }
+  int8_t RSSI() { return -60; }
+  int8_t scanNetworks() { return 0; }
+  String SSID(uint8_t) { return String(); }
+  WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)>) { return nullptr; }
+
+private:
+  WiFiMode_t currentMode = WIFI_OFF;
+  bool started = false;
+};
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HAL.h"
+#include <chrono>
+#include <map>
+#include <sys/stat.h>
+#include <EEPROM.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <ESP8266HTTPClient.h>
+#include <AsyncMqttClient.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+FS LittleFS;
+ESP8266WiFiClass WiFi;
+UpdaterClass Update;
+
+namespace
+{
+  const auto startTime = std::chrono::steady_clock::now();
+  unsigned long clockOffsetMs = 0;
+  uint8_t pins[32] = {};
+  std::string fsRoot = "littlefs";
+  bool networkUp = true;
+  bool brokerUp = true;
+  bool verbose = false;
+  HAL::NetworkStats stats = {};
+  std::vector<std::function<void()>> pendingEvents;
+  ESP8266WebServer *webServer = nullptr;
+
+  std::string hostPath(const char *path)
+  {
+    return fsRoot + ((path[0] == '/') ? "" : "/") + path;
+  }
+}
+
+// ---- HAL ----
+
+void HAL::poll()
+{
+  std::vector<std::function<void()>> events;
+  events.swap(pendingEvents);
+  for (auto &event : events)
+  {
+    event();
+  }
+}
+
+void HAL::defer(std::function<void()> event)
+{
+  pendingEvents.push_back(event);
+}
+
+long HAL::httpGet(const char *uri)
+{
+  return (webServer != nullptr) ? webServer->request(uri) : -1;
+}
+
+void HAL::advanceMillis(unsigned long ms)
+{
+  clockOffsetMs += ms;
+}
+
+void HAL::feedSerial(const char *data, size_t len)
+{
+  Serial.feed(data, len);
+}
+
+int HAL::pinState(uint8_t pin)
+{
+  return (pin < sizeof(pins)) ? pins[pin] : LOW;
+}
+
+void HAL::setFileSystemRoot(const char *path)
+{
+  fsRoot = path;
+}
+
+void HAL::setNetworkUp(bool up)
+{
+  networkUp = up;
+}
+
+bool HAL::isNetworkUp()
+{
+  return networkUp;
+}
+
+void HAL::setBrokerUp(bool up)
+{
+  brokerUp = up;
+}
+
+bool HAL::isBrokerUp()
+{
+  return brokerUp;
+}
+
+void HAL::setVerbose(bool enabled)
+{
+  verbose = enabled;
+}
+
+bool HAL::isVerbose()
+{
+  return verbose;
+}
+
+HAL::NetworkStats &HAL::networkStats()
+{
+  return stats;
+}
+
+// ---- Arduino core ----
+
+unsigned long millis()
+{
+  return micros() / 1000;
+}
+
+unsigned long micros()
+{
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + clockOffsetMs * 1000UL;
+}
+
+void delay(unsigned long ms)
+{
+  HAL::advanceMillis(ms);
+}
+
+void yield()
+{
+  // Busy loops (Yield_Delay) must see the time going on
+  HAL::advanceMillis(1);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < sizeof(pins))
+  {
+    pins[pin] = val;
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return HAL::pinState(pin);
+}
+
+char *dtostrf(double number, signed char width, unsigned char prec, char *s)
+{
+  sprintf(s, "%*.*f", width, prec, number);
+  return s;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  return 40000;
+}
+
+void EspClass::reset()
+{
+  fflush(stdout);
+  exit(0);
+}
+
+void EspClass::restart()
+{
+  fflush(stdout);
+  exit(0);
+}
+
+// ---- LittleFS ----
+
+int File::available()
+{
+  return fp ? static_cast<int>(size() - position()) : 0;
+}
+
+int File::read()
+{
+  return fp ? fgetc(fp.get()) : -1;
+}
+
+int File::peek()
+{
+  if (!fp)
+  {
+    return -1;
+  }
+  int c = fgetc(fp.get());
+  if (c != EOF)
+  {
+    ungetc(c, fp.get());
+  }
+  return c;
+}
+
+size_t File::write(uint8_t c)
+{
+  return fp ? fwrite(&c, 1, 1, fp.get()) : 0;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+  return fp ? fwrite(buffer, 1, size, fp.get()) : 0;
+}
+
+bool File::seek(long pos, SeekMode mode)
+{
+  if (!fp)
+  {
+    return false;
+  }
+  if (mode == SeekEnd && static_cast<long>(size()) + pos < 0)
+  {
+    pos = -static_cast<long>(size());
+  }
+  return fseek(fp.get(), pos, (mode == SeekSet) ? SEEK_SET : (mode == SeekCur) ? SEEK_CUR : SEEK_END) == 0;
+}
+
+size_t File::position() const
+{
+  return fp ? static_cast<size_t>(ftell(fp.get())) : 0;
+}
+
+size_t File::size() const
+{
+  if (!fp)
+  {
+    return 0;
+  }
+  fflush(fp.get());
+  struct stat st;
+  return (fstat(fileno(fp.get()), &st) == 0) ? static_cast<size_t>(st.st_size) : 0;
+}
+
+bool FS::begin()
+{
+  mkdir(fsRoot.c_str(), 0755);
+  struct stat st;
+  return stat(fsRoot.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool FS::format()
+{
+  std::string command = "rm -rf '" + fsRoot + "'";
+  return system(command.c_str()) == 0 && begin();
+}
+
+File FS::open(const char *path, const char *mode)
+{
+  std::string hostMode = std::string(mode) + "b";
+  if (hostMode == "r+b" || hostMode == "w+b" || hostMode == "a+b" || hostMode == "rb" || hostMode == "wb" || hostMode == "ab")
+  {
+    FILE *fp = fopen(hostPath(path).c_str(), hostMode.c_str());
+    return fp ? File(fp) : File();
+  }
+  return File();
+}
+
+bool FS::exists(const char *path)
+{
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to)
+{
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+// ---- Network ----
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase)
+{
+  (void)ssid;
+  (void)passphrase;
+  started = true;
+  return status();
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff)
+{
+  (void)wifioff;
+  started = false;
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status()
+{
+  if (!started)
+  {
+    return WL_DISCONNECTED;
+  }
+  return HAL::isNetworkUp() ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+
+void AsyncMqttClient::connect()
+{
+  HAL::defer([this]()
+  {
+    if (HAL::isNetworkUp() && HAL::isBrokerUp())
+    {
+      isConnected = true;
+      if (connectCallback)
+      {
+        connectCallback(false);
+      }
+    }
+    else if (disconnectCallback)
+    {
+      isConnected = false;
+      disconnectCallback(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+  });
+}
+
+void AsyncMqttClient::disconnect(bool force)
+{
+  (void)force;
+  isConnected = false;
+  HAL::defer([this]()
+  {
+    if (disconnectCallback)
+    {
+      disconnectCallback(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+  });
+}
+
+uint16_t AsyncMqttClient::publish(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length, bool dup, uint16_t message_id)
+{
+  (void)dup;
+  (void)message_id;
+  if (!isConnected)
+  {
+    return 0;
+  }
+  if (length == 0 && payload != nullptr)
+  {
+    length = strlen(payload);
+  }
+  stats.mqttPublish++;
+  stats.mqttBytes += strlen(topic) + length;
+  if (verbose)
+  {
+    printf("[HAL][MQTT] %s (qos:%u retain:%u) = %.*s\n", topic, qos, retain, static_cast<int>(length), payload ? payload : "");
+  }
+  return (qos == 0) ? 1 : ++lastPacketId;
+}
+
+int HTTPClient::GET()
+{
+  stats.httpRequests++;
+  if (verbose)
+  {
+    printf("[HAL][HTTP] GET %s\n", currentUrl.c_str());
+  }
+  return HAL::isNetworkUp() ? 200 : HTTPC_ERROR_CONNECTION_FAILED;
+}
+
+ESP8266WebServer::ESP8266WebServer(int port)
+{
+  (void)port;
+  webServer = this;
+}
+
+ESP8266WebServer::~ESP8266WebServer()
+{
+  if (webServer == this)
+  {
+    webServer = nullptr;
+  }
+}
+
+void ESP8266WebServer::send(int code, const char *content_type, const char *content)
+{
+  (void)code;
+  (void)content_type;
+  replied += strlen(content);
+}
+
+void ESP8266WebServer::sendContent(const char *content)
+{
+  replied += strlen(content);
+}
+
+long ESP8266WebServer::request(const char *uri)
+{
+  auto handler = handlers.find(uri);
+  if (handler == handlers.end())
+  {
+    return -1;
+  }
+  replied = 0;
+  handler->second();
+  return replied;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Control of the simulated hardware, for the host programs of [env:native]
+
+#ifndef HAL_NATIVE_HAL_H
+#define HAL_NATIVE_HAL_H
+
+#include <Arduino.h>
+
+namespace HAL
+{
+  /// @brief Raise the pending events of the stub network (MQTT connection, ...)
+  void poll();
+
+  /// @brief Queue an event for the next poll()
+  void defer(std::function<void()> event);
+
+  /// @brief Request a page of the web server
+  /// @return number of bytes of the reply, -1 if the page is unknown
+  long httpGet(const char *uri);
+
+  /// @brief Move the clock forward (millis()/micros()), without waiting
+  void advanceMillis(unsigned long ms);
+
+  /// @brief Bytes received on the P1 port
+  void feedSerial(const char *data, size_t len);
+
+  /// @brief Last value written on a pin
+  int pinState(uint8_t pin);
+
+  /// @brief Folder of the host that holds the LittleFS files (default : ./littlefs)
+  void setFileSystemRoot(const char *path);
+
+  /// @brief Allow the stub network (WiFi, MQTT broker, HTTP) to connect
+  void setNetworkUp(bool up);
+  bool isNetworkUp();
+
+  /// @brief Broker reachable : when it goes down, the MQTT client is disconnected (WiFi stays up)
+  void setBrokerUp(bool up);
+  bool isBrokerUp();
+
+  /// @brief Print the MQTT publish and the HTTP request on stdout
+  void setVerbose(bool verbose);
+  bool isVerbose();
+
+  /// @brief Statistics of the stub network
+  struct NetworkStats
+  {
+    uint32_t mqttPublish;
+    uint32_t mqttBytes;
+    uint32_t httpRequests;
+  };
+  NetworkStats &networkStats();
+}
+#endif
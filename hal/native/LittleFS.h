@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_LITTLEFS_H
+#define HAL_NATIVE_LITTLEFS_H
+
+#include <Arduino.h>
+#include <memory>
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+/// @brief File of LittleFS, stored as a regular file of the host
+class File : public Stream
+{
+public:
+  using Print::write;
+  File() = default;
+  explicit File(FILE *handle) : fp(handle, fclose) {}
+
+  explicit operator bool() const { return fp != nullptr; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  bool seek(long pos, SeekMode mode);
+  size_t position() const;
+  size_t size() const;
+  void close() { fp.reset(); }
+
+private:
+  std::shared_ptr<FILE> fp;
+};
+
+/// @brief LittleFS backed by a folder of the host (see HAL::setFileSystemRoot)
+class FS
+{
+public:
+  bool begin();
+  bool format();
+  File open(const char *path, const char *mode);
+  File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool rename(const char *from, const char *to);
+};
+extern FS LittleFS;
+
+#endif
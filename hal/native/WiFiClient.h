@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NATIVE_WIFICLIENT_H
+#define HAL_NATIVE_WIFICLIENT_H
+
+#include <Arduino.h>
+#include <memory>
+
+/// @brief TCP client without network : what is written is dropped
+class WiFiClient : public Stream
+{
+public:
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *, size_t size) override { return size; }
+  int availableForWrite() override { return 1460; }
+  uint8_t connected() { return 0; }
+  void stop() {}
+  explicit operator bool() { return false; }
+};
+
+/// @brief TCP server without network : no client will ever connect
+class WiFiServer
+{
+public:
+  explicit WiFiServer(uint16_t port) { (void)port; }
+  void begin() {}
+  void setNoDelay(bool) {}
+  bool hasClient() { return false; }
+  WiFiClient accept() { return WiFiClient(); }
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The part of BearSSL (bundled with the ESP8266 core) used by the firmware : AES-GCM, on top of OpenSSL (link with -lcrypto).
+// Same calls and same incremental behaviour, the speed is the one of the host, not of BearSSL.
+
+#ifndef HAL_NATIVE_BEARSSL_H
+#define HAL_NATIVE_BEARSSL_H
+
+#include <openssl/evp.h>
+#include <cstdint>
+#include <cstring>
+
+struct br_block_ctr_class
+{
+  size_t context_size;
+};
+
+typedef struct
+{
+  const br_block_ctr_class *vtable;
+  unsigned char key[32];
+  size_t keyLength;
+} br_aes_small_ctr_keys;
+
+static const br_block_ctr_class br_aes_small_ctr_vtable = {sizeof(br_aes_small_ctr_keys)};
+
+typedef void (*br_ghash)(void *y, const void *h, const void *data, size_t len);
+inline void br_ghash_ctmul32(void *, const void *, const void *, size_t) {}
+
+/// @brief The direction (encrypt or decrypt) is only known at the first br_gcm_run() : the IV and the AAD wait for it
+typedef struct
+{
+  const br_aes_small_ctr_keys *keys;
+  EVP_CIPHER_CTX *cipher;
+  unsigned char iv[16];
+  size_t ivLength;
+  unsigned char aad[64];
+  size_t aadLength;
+  int encrypt; // -1 = not started
+} br_gcm_context;
+
+inline void br_aes_small_ctr_init(br_aes_small_ctr_keys *ctx, const void *key, size_t len)
+{
+  ctx->vtable = &br_aes_small_ctr_vtable;
+  ctx->keyLength = (len <= sizeof(ctx->key)) ? len : sizeof(ctx->key);
+  memcpy(ctx->key, key, ctx->keyLength);
+}
+
+inline void br_gcm_init(br_gcm_context *ctx, const br_block_ctr_class **bctx, br_ghash)
+{
+  ctx->keys = reinterpret_cast<const br_aes_small_ctr_keys *>(bctx);
+  if (ctx->cipher == nullptr)
+  {
+    ctx->cipher = EVP_CIPHER_CTX_new(); // never freed : one per context of the program
+  }
+  ctx->encrypt = -1;
+}
+
+inline void br_gcm_reset(br_gcm_context *ctx, const void *iv, size_t len)
+{
+  ctx->ivLength = (len <= sizeof(ctx->iv)) ? len : sizeof(ctx->iv);
+  memcpy(ctx->iv, iv, ctx->ivLength);
+  ctx->aadLength = 0;
+  ctx->encrypt = -1;
+}
+
+inline void br_gcm_aad_inject(br_gcm_context *ctx, const void *data, size_t len)
+{
+  if (ctx->aadLength + len <= sizeof(ctx->aad))
+  {
+    memcpy(ctx->aad + ctx->aadLength, data, len);
+    ctx->aadLength += len;
+  }
+}
+
+inline void br_gcm_flip(br_gcm_context *) {}
+
+inline void br_gcm_start(br_gcm_context *ctx, int encrypt)
+{
+  if (ctx->encrypt >= 0)
+  {
+    return;
+  }
+  const EVP_CIPHER *aes = (ctx->keys->keyLength == 32) ? EVP_aes_256_gcm() : (ctx->keys->keyLength == 24) ? EVP_aes_192_gcm() : EVP_aes_128_gcm();
+  int len;
+  EVP_CipherInit_ex(ctx->cipher, aes, nullptr, nullptr, nullptr, encrypt);
+  EVP_CIPHER_CTX_ctrl(ctx->cipher, EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(ctx->ivLength), nullptr);
+  EVP_CipherInit_ex(ctx->cipher, nullptr, nullptr, ctx->keys->key, ctx->iv, encrypt);
+  EVP_CipherUpdate(ctx->cipher, nullptr, &len, ctx->aad, static_cast<int>(ctx->aadLength));
+  ctx->encrypt = encrypt;
+}
+
+inline void br_gcm_run(br_gcm_context *ctx, int encrypt, void *data, size_t len)
+{
+  int out;
+  br_gcm_start(ctx, encrypt);
+  EVP_CipherUpdate(ctx->cipher, static_cast<unsigned char *>(data), &out, static_cast<unsigned char *>(data), static_cast<int>(len));
+}
+
+inline void br_gcm_get_tag_trunc(br_gcm_context *ctx, void *tag, size_t len)
+{
+  int out;
+  unsigned char full[16];
+  br_gcm_start(ctx, 1);
+  EVP_CipherFinal_ex(ctx->cipher, full, &out);
+  EVP_CIPHER_CTX_ctrl(ctx->cipher, EVP_CTRL_GCM_GET_TAG, 16, full);
+  memcpy(tag, full, (len <= 16) ? len : 16);
+}
+
+inline uint32_t br_gcm_check_tag_trunc(br_gcm_context *ctx, const void *tag, size_t len)
+{
+  int out;
+  unsigned char end[16];
+  br_gcm_start(ctx, 0);
+  EVP_CIPHER_CTX_ctrl(ctx->cipher, EVP_CTRL_GCM_SET_TAG, static_cast<int>(len), const_cast<void *>(tag));
+  return EVP_CipherFinal_ex(ctx->cipher, end, &out) > 0;
+}
+
+#endif
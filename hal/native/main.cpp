@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host entry point of [env:native] : run the firmware (setup/loop) with a meter simulated
+// from a telegram file. The meter sends the telegram every second while Data Request is high.
+// A file with several telegrams (ex: /rawhistory of a module) is sent one telegram after the other.
+//
+// Usage : program [-m] [-j] [-h] [-v] [-c decimation] [-d] [-n count] [-b A:B] [-f folder] telegram.txt
+//   -m        enable MQTT (broker simulated)
+//   -j        MQTT : all the values in one JSON document (<mqttTopic>/reading)
+//   -h        MQTT : Home Assistant discovery
+//   -c N      continuous read (Data Request always high), consumers get 1 telegram out of N
+//   -d        send only the changed values (MQTT, Domoticz)
+//   -v        print the MQTT publish and HTTP requests
+//   -n count  number of telegrams sent before exit (default 10)
+//   -b A:B    MQTT broker unreachable from the telegram A to the telegram B (excluded)
+//   -f folder folder used as LittleFS (default ./littlefs)
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unistd.h>
+#include "HAL.h"
+#include "GlobalVar.h"
+#include "P1Reader.h"
+
+void setup();
+void loop();
+
+#define LOOP_STEP_MS 10
+#define METER_PERIOD_MS 1000
+
+static bool loadFile(const char *path, std::string &content)
+{
+  FILE *fp = fopen(path, "rb");
+  if (fp == nullptr)
+  {
+    return false;
+  }
+  char buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    content.append(buffer, len);
+  }
+  fclose(fp);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  bool mqtt = false;
+  bool continuous = false;
+  unsigned int decimation = 1;
+  bool onlyChanged = false;
+  bool json = false;
+  bool discovery = false;
+  unsigned long count = 10;
+  unsigned long brokerDown = 0;
+  unsigned long brokerUp = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "mjhvc:dn:b:f:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'm':
+      mqtt = true;
+      break;
+    case 'j':
+      json = true;
+      break;
+    case 'h':
+      discovery = true;
+      break;
+    case 'v':
+      HAL::setVerbose(true);
+      break;
+    case 'c':
+      continuous = true;
+      decimation = std::max(1UL, strtoul(optarg, nullptr, 10));
+      break;
+    case 'd':
+      onlyChanged = true;
+      break;
+    case 'n':
+      count = strtoul(optarg, nullptr, 10);
+      break;
+    case 'b':
+      brokerDown = strtoul(optarg, nullptr, 10);
+      brokerUp = (strchr(optarg, ':') != nullptr) ? strtoul(strchr(optarg, ':') + 1, nullptr, 10) : brokerDown;
+      break;
+    case 'f':
+      HAL::setFileSystemRoot(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-m] [-j] [-h] [-v] [-c decimation] [-d] [-n count] [-b A:B] [-f folder] telegram.txt\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::string content;
+  if (optind >= argc || !loadFile(argv[optind], content))
+  {
+    fprintf(stderr, "Usage: %s [-m] [-j] [-h] [-v] [-c decimation] [-d] [-n count] [-b A:B] [-f folder] telegram.txt\n", argv[0]);
+    return 1;
+  }
+
+  // one telegram per '/'
+  std::vector<std::string> telegrams;
+  for (size_t start = 0; start < content.size();)
+  {
+    size_t next = content.find("\n/", start);
+    next = (next == std::string::npos) ? content.size() : next + 1;
+    telegrams.push_back(content.substr(start, next - start));
+    start = next;
+  }
+  if (telegrams.empty())
+  {
+    telegrams.push_back(content);
+  }
+
+  // Configuration already done, as on a module in service
+  settings conf;
+  conf.ConfigVersion = SETTINGVERSION;
+  conf.NeedConfig = false;
+  strcpy(conf.ssid, "native");
+  conf.password[0] = '\0';
+  strcpy(conf.domoticzIP, "127.0.0.1");
+  conf.domoticzPort = 8080;
+  conf.domoticzEnergyIdx = 0;
+  conf.domoticzGasIdx = 0;
+  strcpy(conf.mqttTopic, "dsmr");
+  strcpy(conf.mqttIP, "127.0.0.1");
+  conf.mqttPort = 1883;
+  conf.mqttUser[0] = '\0';
+  conf.mqttPass[0] = '\0';
+  conf.interval = 10;
+  conf.domo = false;
+  conf.mqtt = mqtt;
+  conf.adminPassword[0] = '\0';
+  conf.adminUser[0] = '\0';
+  conf.Repport2Telnet = false;
+  conf.debugToDomo = false;
+  conf.domoticzDebugIdx = 0;
+  conf.continuousRead = continuous;
+  conf.mqttDecimation = decimation;
+  conf.domoDecimation = decimation;
+  conf.telnetDecimation = decimation;
+  conf.logDecimation = decimation;
+  conf.sendOnlyChanged = onlyChanged;
+  conf.fullRefresh = 300;
+  conf.p1Key[0] = '\0';
+  conf.mqttJson = json;
+  conf.mqttDiscovery = discovery;
+  const byte qos[MQTT_CLASSES] = {0, 1, 1, 0};
+  const bool retain[MQTT_CLASSES] = {false, true, true, false};
+  memcpy(conf.mqttQoS, qos, sizeof(qos));
+  memcpy(conf.mqttRetain, retain, sizeof(retain));
+  EEPROM.begin(sizeof(settings));
+  EEPROM.put(0, conf);
+
+  setup();
+
+  unsigned long sent = 0;
+  unsigned long nextTelegram = 0;
+  unsigned long stopAt = 0;
+  unsigned long giveUpAt = millis() + (count + 1) * (conf.interval * 1000UL + P1TIMEOUTREAD);
+
+  while ((stopAt == 0 || millis() < stopAt) && millis() < giveUpAt)
+  {
+    if (sent < count && HAL::pinState(DR) == HIGH && millis() >= nextTelegram)
+    {
+      if (brokerDown != brokerUp)
+      {
+        HAL::setBrokerUp(sent < brokerDown || sent >= brokerUp);
+      }
+      const std::string &telegram = telegrams[sent % telegrams.size()];
+      HAL::feedSerial(telegram.data(), telegram.size());
+      nextTelegram = millis() + METER_PERIOD_MS;
+      if (++sent == count)
+      {
+        stopAt = millis() + METER_PERIOD_MS;
+      }
+    }
+
+    loop();
+    HAL::poll();
+    HAL::advanceMillis(LOOP_STEP_MS);
+  }
+
+  HAL::NetworkStats &stats = HAL::networkStats();
+  printf("[HAL] telegrams sent: %lu, MQTT publish: %u (%u bytes), HTTP requests: %u\n", sent, stats.mqttPublish, stats.mqttBytes, stats.httpRequests);
+  return 0;
+}
@@ -24,36 +24,75 @@
 
 #include "DomoticzMgr.h"
 
+#define DOMOTICZ_POSITIONS 6 // values in the sValue of the "P1 Smart Meter" device
+#define DOMOTICZ_BIT(field, type, size, a, b, c, d, e, alt, mqtt, jsonGroup, json, unit, domoticz) | ((domoticz != 0) ? (1ULL << P1Reader::Field::field) : 0)
+
+/// @brief Fields sent in the sValue of the "P1 Smart Meter" device
+static constexpr uint64_t DomoticzFields = 0 P1_FIELDS(DOMOTICZ_BIT);
+
 DomoticzMgr::DomoticzMgr(settings &configuration, P1Reader &currentP1) : conf(configuration), P1Captor(currentP1)
 {
-  P1Captor.OnNewDatagram([this]()
+  P1Captor.OnNewDatagram([this](uint64_t changed)
   {
-    UpdateElectricity();
-    UpdateGas();
-  });
+    UpdateElectricity(changed);
+    UpdateGas(changed);
+  }, conf.domoDecimation, true);
 }
 
-void DomoticzMgr::UpdateGas()
+void DomoticzMgr::UpdateGas(uint64_t changed)
 {
   if (conf.domoticzGasIdx == 0)
   {
     return;
   }
 
+  const P1Reader::DataP1 &data = P1Captor.GetSnapshot();
+  uint8_t gas = P1Reader::GasChannel(data);
+  if (gas == 0 || ((changed >> P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)) & 1) == 0)
+  {
+    return;
+  }
+
   MainSendDebugPrintf("[DMTCZ] Send Gas");
-  SendToDomoticz(conf.domoticzGasIdx, P1Captor.DataReaded.gasDomoticz, false);
+  char sValue[21];
+  P1Reader::FieldToChars(data, P1Reader::GetFieldInfo(P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)), sValue, sizeof(sValue));
+  SendToDomoticz(conf.domoticzGasIdx, sValue, false);
 }
 
-void DomoticzMgr::UpdateElectricity()
+void DomoticzMgr::UpdateElectricity(uint64_t changed)
 {
   if (conf.domoticzEnergyIdx == 0)
   {
     return;
   }
 
-  MainSendDebugPrintf("[DMTCZ] Send Gas");
-  char sValue[300];
-  sprintf(sValue, "%f;%f;%f;%f;%f;%f", P1Captor.DataReaded.electricityUsedTariff1.val(), P1Captor.DataReaded.electricityUsedTariff2.val(), P1Captor.DataReaded.electricityReturnedTariff1.val(), P1Captor.DataReaded.electricityReturnedTariff2.val(), P1Captor.DataReaded.actualElectricityPowerDeli.val(), P1Captor.DataReaded.actualElectricityPowerRet.val());
+  if ((changed & DomoticzFields) == 0)
+  {
+    return;
+  }
+
+  MainSendDebugPrintf("[DMTCZ] Send Electricity");
+  const P1Reader::DataP1 &data = P1Captor.GetSnapshot();
+  P1Reader::FieldInfo values[DOMOTICZ_POSITIONS];
+  for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+    if (info.domoticz != 0 && info.domoticz <= DOMOTICZ_POSITIONS)
+    {
+      values[info.domoticz - 1] = info;
+    }
+  }
+
+  char sValue[130];
+  size_t len = 0;
+  for (const P1Reader::FieldInfo &info : values)
+  {
+    if (len != 0)
+    {
+      sValue[len++] = ';';
+    }
+    len += P1Reader::FieldToChars(data, info, &sValue[len], sizeof(sValue) - len);
+  }
   SendToDomoticz(conf.domoticzEnergyIdx, sValue, false);
 }
 
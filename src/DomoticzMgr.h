@@ -42,9 +42,11 @@ private:
   P1Reader &P1Captor;
 
   /// @brief sends the gas usage to server
-  void UpdateGas();
+  /// @param changed fields changed since the last call, see P1Reader::Field (P1Reader::AllFields for a full report)
+  void UpdateGas(uint64_t changed);
   /// @brief sends the electricity usage to server
-  void UpdateElectricity();
+  /// @param changed fields changed since the last call, see P1Reader::Field (P1Reader::AllFields for a full report)
+  void UpdateElectricity(uint64_t changed);
   /// @brief Send to Domoticz data
   /// @param idx
   /// @param nValue
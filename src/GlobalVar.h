@@ -39,7 +39,19 @@
 #define LED_OFF 0x1
 
 #define SETTINGVERSIONNULL 0 //= no config
-#define SETTINGVERSION 3
+#define SETTINGVERSION 4
+#define SETTINGVERSIONV3 3 // firmware 1.03, reprise par MigrateSettings()
+
+#define TARIFF_AUTO 0    // selon le profil du compteur (inversé pour les compteurs belges)
+#define TARIFF_NORMAL 1  // comme le compteur
+#define TARIFF_INVERSE 2 // tarifs 1 et 2 inversés
+
+// classes de topics MQTT, chacune avec sa QoS et son retain (settings::mqttQoS, settings::mqttRetain)
+#define MQTT_LIVE 0    // valeurs instantanées : puissance, tension, courant, tarif en cours, heure du datagramme
+#define MQTT_COUNTER 1 // index cumulés : énergie, M-Bus (gaz, eau), nombre de pannes, pics, document JSON
+#define MQTT_STATE 2   // état du module (State/) et identification du compteur
+#define MQTT_LOGGING 3 // debug (State/Logging)
+#define MQTT_CLASSES 4
 
 struct settings
 {
@@ -60,7 +72,7 @@ struct settings
   unsigned int interval;
   bool domo = true;
   bool mqtt = false;
-  bool InverseHigh_1_2_Tarif = false;
+  byte tariffOrder = TARIFF_AUTO; // ordre des tarifs 1 et 2, voir TARIFF_AUTO
   bool telnet = false;
   bool debugToMqtt = false;
   bool debugToTelnet = false;
@@ -69,6 +81,18 @@ struct settings
   bool Repport2Telnet;
   bool debugToDomo = true;
   unsigned int domoticzDebugIdx;
+  bool continuousRead = false;    // Data Request toujours actif : un datagramme par seconde (DSMR5)
+  unsigned int mqttDecimation;     // 1 datagramme sur N envoyé à MQTT
+  unsigned int domoDecimation;     // 1 datagramme sur N envoyé à Domoticz
+  unsigned int telnetDecimation;   // 1 datagramme sur N envoyé en Telnet
+  unsigned int logDecimation;      // 1 datagramme sur N pour l'historique 24h
+  bool sendOnlyChanged;            // MQTT et Domoticz : seulement les valeurs modifiées
+  unsigned int fullRefresh;        // en sec, envoi complet périodique malgré sendOnlyChanged (0 = jamais)
+  char p1Key[33];                  // clé du compteur en hexadécimal pour les datagrammes chiffrés (Smarty), "" = en clair
+  bool mqttJson;                   // MQTT : tout le datagramme en un seul JSON sur <mqttTopic>/reading au lieu d'un topic par valeur
+  byte mqttQoS[MQTT_CLASSES];      // QoS (0 à 2) par classe de topic, voir MQTT_LIVE
+  bool mqttRetain[MQTT_CLASSES];   // retain par classe de topic
+  bool mqttDiscovery;              // MQTT : configuration des capteurs pour Home Assistant (homeassistant/sensor/...)
 };
 
 #ifndef LANGUAGE
@@ -57,6 +57,7 @@ void HTTPMgr::start_webservices()
   server.on("/reboot", std::bind(&HTTPMgr::handleReboot, this));
   server.on("/P1", std::bind(&HTTPMgr::handleP1, this));
   server.on("/raw", std::bind(&HTTPMgr::handleRAW, this));
+  server.on("/rawhistory", std::bind(&HTTPMgr::handleRawHistory, this));
   server.on("/update", HTTP_GET, std::bind(&HTTPMgr::handleUploadForm, this));
   server.on("/update", HTTP_POST, [this]()
             {
@@ -216,14 +217,31 @@ void HTTPMgr::ReplyOTA(bool success, const char *error, u_int ref)
 
 void HTTPMgr::handleRAW()
 {
-  server.send(200, "Text/plain", P1Captor.datagram);
+  const P1History &history = P1Captor.GetHistory();
+  WiFiClient &client = server.client();
+
+  server.setContentLength(history.LastSize());
+  server.send(200, "text/plain", "");
+  history.ReplayLast([&client](const char *text, size_t len)
+                     { client.write(text, len); });
+}
+
+void HTTPMgr::handleRawHistory()
+{
+  const P1History &history = P1Captor.GetHistory();
+  WiFiClient &client = server.client();
+
+  server.setContentLength(history.ReplaySize());
+  server.send(200, "text/plain", "");
+  history.Replay([&client](const char *text, size_t len)
+                 { client.write(text, len); });
 }
 
 void HTTPMgr::handleP1Js()
 {
   if (ActifCache(true))
     return;
-  static const char template_html[] PROGMEM = R"(async function updateValues(){try{let e=await fetch("P1.json"),a=await e.json();document.getElementById("LastSample").value=parseDateTime(a.LastSample).toLocaleString(),document.getElementById("T1").value=a.P1.T1+" kWh",document.getElementById("T2").value=a.P1.T2+" kWh",document.getElementById("RT1").value=a.P1.RT1+" kWh",document.getElementById("RT2").value=a.P1.RT2+" kWh",document.getElementById("TA").value=a.P1.TA+" kWh",document.getElementById("RTA").value=a.P1.RTA+" kWh",document.getElementById("VL1").value=a.P1.V.L1+" V",document.getElementById("VL2").value=a.P1.V.L2+" V",document.getElementById("VL3").value=a.P1.V.L3+" V",document.getElementById("AL1").value=a.P1.A.L1+" A",document.getElementById("AL2").value=a.P1.A.L2+" A",document.getElementById("AL3").value=a.P1.A.L3+" A",document.getElementById("gasReceived5min").value=a.P1.gasReceived5min+" m3"}catch(t){console.error("Error on update :",t)}}setInterval(updateValues,1e4),window.onload=updateValues;)";
+  static const char template_html[] PROGMEM = R"(async function updateValues(){try{let e=await fetch("P1.json"),a=await e.json();document.getElementById("LastSample").value=parseDateTime(a.Epoch).toLocaleString(),document.getElementById("T1").value=a.P1.T1+" kWh",document.getElementById("T2").value=a.P1.T2+" kWh",document.getElementById("RT1").value=a.P1.RT1+" kWh",document.getElementById("RT2").value=a.P1.RT2+" kWh",document.getElementById("TA").value=a.P1.TA+" kWh",document.getElementById("RTA").value=a.P1.RTA+" kWh",document.getElementById("VL1").value=a.P1.V.L1+" V",document.getElementById("VL2").value=a.P1.V.L2+" V",document.getElementById("VL3").value=a.P1.V.L3+" V",document.getElementById("AL1").value=a.P1.A.L1+" A",document.getElementById("AL2").value=a.P1.A.L2+" A",document.getElementById("AL3").value=a.P1.A.L3+" A",document.getElementById("gasReceived5min").value=a.P1.gasReceived5min+" m3"}catch(t){console.error("Error on update :",t)}}setInterval(updateValues,1e4),window.onload=updateValues;)";
   server.send(200, "application/javascript", template_html);
 }
 
@@ -264,7 +282,7 @@ void HTTPMgr::handleMainJS()
   if (ActifCache(true))
     return;
 
-  static char js[] PROGMEM = R"(function parseDateTime(t){return new Date("20"+t.substring(0,2),t.substring(2,4)-1,t.substring(4,6),t.substring(6,8),t.substring(8,10),t.substring(10,12))}async function updateStatus(){try{let e=await fetch("status.json"),s=await e.json();const r=document.getElementById("MQTT-indicator");null!=r&&(1==s.MQTT?r.classList.remove("error"):r.classList.add("error"));const n=document.getElementById("P1-indicator");if(""!=s.P1.LastSample){var t=parseDateTime(s.P1.LastSample);Date.now().set;t.setSeconds(t.getSeconds()+3*s.P1.Interval),t<Date.now()?n.classList.add("error"):n.classList.remove("error")}else n.classList.add("error")}catch(t){console.error("Error on update status:",t)}}window.onload=function(){updateStatus();document.querySelectorAll(".bwarning").forEach((t=>{t.addEventListener("click",(function(t){confirm(")" LANG_ASKCONFIRM R"(")||t.preventDefault()}))})),setInterval(updateStatus,1e4)};)";
+  static char js[] PROGMEM = R"(function parseDateTime(t){return"number"==typeof t?new Date(1e3*t):new Date("20"+t.substring(0,2),t.substring(2,4)-1,t.substring(4,6),t.substring(6,8),t.substring(8,10),t.substring(10,12))}async function updateStatus(){try{let e=await fetch("status.json"),s=await e.json();const r=document.getElementById("MQTT-indicator");null!=r&&(1==s.MQTT?r.classList.remove("error"):r.classList.add("error"));const n=document.getElementById("P1-indicator");if(s.P1.LastSample){var t=parseDateTime(s.P1.LastSample);Date.now().set;t.setSeconds(t.getSeconds()+3*s.P1.Interval),t<Date.now()?n.classList.add("error"):n.classList.remove("error")}else n.classList.add("error")}catch(t){console.error("Error on update status:",t)}}window.onload=function(){updateStatus();document.querySelectorAll(".bwarning").forEach((t=>{t.addEventListener("click",(function(t){confirm(")" LANG_ASKCONFIRM R"(")||t.preventDefault()}))})),setInterval(updateStatus,1e4)};)";
 
   server.send(200, "application/javascript", js);
 }
@@ -482,7 +500,12 @@ void HTTPMgr::handleSetup()
 <form action="/SetupSave" method="post">
 <fieldset><legend>)" LANG_ConfP1H2 R"(</legend>
 <label for="interval">)" LANG_ConfReadP1Intr R"( :</label><input type="number" min="10" id="interval" name="interval" value="%u"><br />
-<label for="InvTarif">)" LANG_ConfPERMUTTARIF R"( :</label><input type="checkbox" name="InvTarif" id="InvTarif" %s><br />
+<label for="tariffOrder">)" LANG_ConfPERMUTTARIF R"( :</label><select name="tariffOrder" id="tariffOrder"><option value="0"%s>)" LANG_ConfTariffAuto R"(</option><option value="1"%s>)" LANG_ConfTariffNormal R"(</option><option value="2"%s>)" LANG_ConfTariffInverse R"(</option></select><br />
+<label for="continuous">)" LANG_ConfContinuous R"( :</label><input type="checkbox" name="continuous" id="continuous" %s><br />
+<label for="p1Key">)" LANG_ConfP1Key R"( :</label><input type="password" id="p1Key" name="p1Key" maxlength="32" pattern="([0-9A-Fa-f]{32})?" value="%s"><br />
+<label for="logDecimation">)" LANG_ConfLogDecimation R"( :</label><input type="number" min="1" id="logDecimation" name="logDecimation" value="%u"><br />
+<label for="onlyChanged">)" LANG_ConfOnlyChanged R"( :</label><input type="checkbox" name="onlyChanged" id="onlyChanged" %s><br />
+<label for="fullRefresh">)" LANG_ConfFullRefresh R"( :</label><input type="number" min="0" id="fullRefresh" name="fullRefresh" value="%u"><br />
 </fieldset>
 <fieldset><legend>)" LANG_ConfWIFIH2 R"(</legend>
 <label for="ssid">)" LANG_ConfSSID R"( :</label><input type="text" name="ssid" id="ssid" maxlength="32" value="%s"><br />
@@ -496,6 +519,7 @@ void HTTPMgr::handleSetup()
 <label for="domoticzEnergyIdx">)" LANG_ConfDMTZEIdx R"( :</label><input type="number" min="0" id="domoticzEnergyIdx" name="domoticzEnergyIdx" value="%u">
 <label for="domoticzDebugIdx">)" LANG_ConfDMTZDIdx R"( :</label><input type="number" min="0" id="domoticzDebugIdx" name="domoticzDebugIdx" value="%u">
 <label for="debugToDomo">)" LANG_ConfDOMODBG R"( :</label><input type="checkbox" name="debugToDomo" id="debugToDomo" %s><br />
+<label for="domoDecimation">)" LANG_ConfDecimation R"( :</label><input type="number" min="1" id="domoDecimation" name="domoDecimation" value="%u"><br />
 </fieldset>
 <fieldset><legend>)" LANG_ConfMQTTH2 R"(</legend>
 <label for="mqtt">)" LANG_ConfMQTTBool R"( :</label><input type="checkbox" name="mqtt" id="mqtt" %s><br />
@@ -504,11 +528,20 @@ void HTTPMgr::handleSetup()
 <label for="mqttUser">)" LANG_ConfMQTTUsr R"( :</label><input type="text" id="mqttUser" name="mqttUser" maxlength="31" value="%s"><br />
 <label for="mqttPass">)" LANG_ConfMQTTPSW R"( :</label><input type="password" id="mqttPass" name="mqttPass" maxlength="31" value="%s"><br />
 <label for="mqttTopic">)" LANG_ConfMQTTRoot R"( :</label><input type="text" id="mqttTopic" name="mqttTopic" maxlength="49" value="%s"><br />
+<label for="mqttJson">)" LANG_ConfMQTTJson R"( :</label><input type="checkbox" name="mqttJson" id="mqttJson" %s><br />
+<label for="mqttDiscovery">)" LANG_ConfMQTTDiscovery R"( :</label><input type="checkbox" name="mqttDiscovery" id="mqttDiscovery" %s><br />
 <label for="debugToMqtt">)" LANG_ConfMQTTDBG R"( :</label><input type="checkbox" name="debugToMqtt" id="debugToMqtt" %s><br />
+<label for="mqttDecimation">)" LANG_ConfDecimation R"( :</label><input type="number" min="1" id="mqttDecimation" name="mqttDecimation" value="%u"><br />
+<p>)" LANG_ConfMQTTPolicy R"(</p>
+<label for="q0">)" LANG_ConfMQTTLive R"( :</label><input type="number" min="0" max="2" id="q0" name="q0" value="%u"><input type="checkbox" name="r0" %s><br />
+<label for="q1">)" LANG_ConfMQTTCounter R"( :</label><input type="number" min="0" max="2" id="q1" name="q1" value="%u"><input type="checkbox" name="r1" %s><br />
+<label for="q2">)" LANG_ConfMQTTState R"( :</label><input type="number" min="0" max="2" id="q2" name="q2" value="%u"><input type="checkbox" name="r2" %s><br />
+<label for="q3">)" LANG_ConfMQTTLogging R"( :</label><input type="number" min="0" max="2" id="q3" name="q3" value="%u"><input type="checkbox" name="r3" %s><br />
 </fieldset>
 <fieldset><legend>)" LANG_ConfTLNETH2 R"(</legend>
 <label for="telnet">)" LANG_ConfTLNETBool R"( :</label><input type="checkbox" name="telnet" id="telnet" %s><br />
 <label for="reportToTelnet">)" LANG_ConfTLNETREPPORT R"( :</label><input type="checkbox" name="reportToTelnet" id="reportToTelnet" %s><br />
+<label for="telnetDecimation">)" LANG_ConfDecimation R"( :</label><input type="number" min="1" id="telnetDecimation" name="telnetDecimation" value="%u"><br />
 <label for="debugToTelnet">)" LANG_ConfTLNETDBG R"( :</label><input type="checkbox" name="debugToTelnet" id="debugToTelnet" %s><br />
 </fieldset>
 <span id="passwordError" class="error"></span>
@@ -518,7 +551,14 @@ void HTTPMgr::handleSetup()
 
   snprintf_P(HTMLBufferContent, sizeof(HTMLBufferContent), template_html,
              conf.interval,
-             (conf.InverseHigh_1_2_Tarif) ? "checked" : "",
+             (conf.tariffOrder == TARIFF_AUTO) ? " selected" : "",
+             (conf.tariffOrder == TARIFF_NORMAL) ? " selected" : "",
+             (conf.tariffOrder == TARIFF_INVERSE) ? " selected" : "",
+             (conf.continuousRead) ? "checked" : "",
+             conf.p1Key, // hexadécimal, vérifié à l'enregistrement
+             conf.logDecimation,
+             (conf.sendOnlyChanged) ? "checked" : "",
+             conf.fullRefresh,
              nettoyerInputText(conf.ssid, 33),
              nettoyerInputText(conf.password, 65),
              (conf.domo) ? "checked" : "",
@@ -528,15 +568,24 @@ void HTTPMgr::handleSetup()
              conf.domoticzEnergyIdx,
              conf.domoticzDebugIdx,
              (conf.debugToDomo) ? "checked" : "",
+             conf.domoDecimation,
              (conf.mqtt) ? "checked" : "",
              nettoyerInputText(conf.mqttIP, 30),
              conf.mqttPort,
              nettoyerInputText(conf.mqttUser, 32),
              nettoyerInputText(conf.mqttPass, 32),
              nettoyerInputText(conf.mqttTopic, 50),
+             (conf.mqttJson) ? "checked" : "",
+             (conf.mqttDiscovery) ? "checked" : "",
              (conf.debugToMqtt) ? "checked" : "",
+             conf.mqttDecimation,
+             conf.mqttQoS[MQTT_LIVE], (conf.mqttRetain[MQTT_LIVE]) ? "checked" : "",
+             conf.mqttQoS[MQTT_COUNTER], (conf.mqttRetain[MQTT_COUNTER]) ? "checked" : "",
+             conf.mqttQoS[MQTT_STATE], (conf.mqttRetain[MQTT_STATE]) ? "checked" : "",
+             conf.mqttQoS[MQTT_LOGGING], (conf.mqttRetain[MQTT_LOGGING]) ? "checked" : "",
              (conf.telnet) ? "checked" : "",
              (conf.Repport2Telnet) ? "checked" : "",
+             conf.telnetDecimation,
              (conf.debugToTelnet) ? "checked" : "");
 
   SendWithHeaderFooter("text/html", HTMLBufferContent, "", false);
@@ -566,6 +615,7 @@ void HTTPMgr::handleSetupSave()
     NewConf.domoticzGasIdx = server.arg("domoticzGasIdx").toInt();
     NewConf.domoticzDebugIdx = server.arg("domoticzDebugIdx").toInt();
     NewConf.debugToDomo = (server.arg("debugToDomo") == "on");
+    NewConf.domoDecimation = std::max(1L, server.arg("domoDecimation").toInt());
 
     NewConf.mqtt = (server.arg("mqtt") == "on");
     server.arg("mqttIP").toCharArray(NewConf.mqttIP, sizeof(NewConf.mqttIP));
@@ -573,13 +623,34 @@ void HTTPMgr::handleSetupSave()
     server.arg("mqttUser").toCharArray(NewConf.mqttUser, sizeof(NewConf.mqttUser));
     server.arg("mqttPass").toCharArray(NewConf.mqttPass, sizeof(NewConf.mqttPass));
     server.arg("mqttTopic").toCharArray(NewConf.mqttTopic, sizeof(NewConf.mqttTopic));
+    NewConf.mqttJson = (server.arg("mqttJson") == "on");
+    NewConf.mqttDiscovery = (server.arg("mqttDiscovery") == "on");
     NewConf.debugToMqtt = (server.arg("debugToMqtt") == "on");
+    NewConf.mqttDecimation = std::max(1L, server.arg("mqttDecimation").toInt());
+    for (uint8_t topicClass = 0; topicClass < MQTT_CLASSES; topicClass++)
+    {
+      char name[3] = {'q', static_cast<char>('0' + topicClass), '\0'};
+      NewConf.mqttQoS[topicClass] = std::min(2L, std::max(0L, server.arg(name).toInt()));
+      name[0] = 'r';
+      NewConf.mqttRetain[topicClass] = (server.arg(name) == "on");
+    }
 
     NewConf.interval = server.arg("interval").toInt();
-    NewConf.InverseHigh_1_2_Tarif = (server.arg("InvTarif") == "on");
+    NewConf.tariffOrder = std::min(static_cast<long>(TARIFF_INVERSE), std::max(0L, server.arg("tariffOrder").toInt()));
+    NewConf.continuousRead = (server.arg("continuous") == "on");
+    server.arg("p1Key").toCharArray(NewConf.p1Key, sizeof(NewConf.p1Key));
+    uint8_t key[P1KEYSIZE];
+    if (NewConf.p1Key[0] != '\0' && !P1Decryptor::ParseKey(NewConf.p1Key, key))
+    {
+      NewConf.p1Key[0] = '\0'; // pas 32 caractères hexadécimaux
+    }
+    NewConf.logDecimation = std::max(1L, server.arg("logDecimation").toInt());
+    NewConf.sendOnlyChanged = (server.arg("onlyChanged") == "on");
+    NewConf.fullRefresh = std::max(0L, server.arg("fullRefresh").toInt());
     NewConf.telnet = (server.arg("telnet") == "on");
     NewConf.debugToTelnet = (server.arg("debugToTelnet") == "on");
     NewConf.Repport2Telnet = (server.arg("reportToTelnet") == "on");
+    NewConf.telnetDecimation = std::max(1L, server.arg("telnetDecimation").toInt());
 
     NewConf.ConfigVersion = SETTINGVERSION;
 
@@ -638,12 +709,13 @@ void HTTPMgr::handleP1()
 
 void HTTPMgr::handleJSONStatus()
 {
-  char out[90];
+  char out[128];
   JsonDocument doc;
 
-  doc["P1"]["LastSample"] = P1Captor.DataReaded.P1timestamp;
-  doc["P1"]["Interval"] = conf.interval;
+  doc["P1"]["LastSample"] = P1Captor.GetSnapshot().epoch; // UTC, 0 = none
+  doc["P1"]["Interval"] = conf.continuousRead ? 1 : conf.interval;
   doc["P1"]["NextUpdateIn"] = P1Captor.GetnextUpdateTime() - millis();
+  doc["P1"]["CRCErrors"] = P1Captor.crcErrors;
   if (conf.mqtt)
   {
     doc["MQTT"] = MQTT.IsConnected();
@@ -655,30 +727,94 @@ void HTTPMgr::handleJSONStatus()
   server.send(200, "application/json", out);
 }
 
+/// @brief The field is sent in P1.json, in this group ("" : directly in "P1")
+static bool inJsonGroup(const P1Reader::DataP1 &data, const P1Reader::FieldInfo &info, const char *group)
+{
+  return pgm_read_byte(info.json) != '\0' && strcmp_P(group, info.jsonGroup) == 0 && P1Reader::FieldPresent(data, info);
+}
+
 void HTTPMgr::handleJSON()
 {
-  char str[1000];
-  JsonDocument doc;
-  doc["LastSample"] = P1Captor.DataReaded.P1timestamp;
-  doc["NextUpdateIn"] = P1Captor.GetnextUpdateTime() - millis();
-  doc["P1"]["T1"] = P1Captor.DataReaded.electricityUsedTariff1.val();
-  doc["P1"]["T2"] = P1Captor.DataReaded.electricityUsedTariff2.val();
-  doc["P1"]["RT1"] = P1Captor.DataReaded.electricityReturnedTariff1.val();
-  doc["P1"]["RT2"] = P1Captor.DataReaded.electricityReturnedTariff2.val();
-  doc["P1"]["TA"] = P1Captor.DataReaded.actualElectricityPowerDeli.val();
-  doc["P1"]["RTA"] = P1Captor.DataReaded.actualElectricityPowerRet.val();
-  doc["P1"]["V"]["L1"] = P1Captor.DataReaded.instantaneousVoltageL1.val();
-  doc["P1"]["V"]["L2"] = P1Captor.DataReaded.instantaneousVoltageL2.val();
-  doc["P1"]["V"]["L3"] = P1Captor.DataReaded.instantaneousVoltageL3.val();
-  doc["P1"]["A"]["L1"] = P1Captor.DataReaded.instantaneousCurrentL1.val();
-  doc["P1"]["A"]["L2"] = P1Captor.DataReaded.instantaneousCurrentL2.val();
-  doc["P1"]["A"]["L3"] = P1Captor.DataReaded.instantaneousCurrentL3.val();
-  doc["P1"]["gasReceived5min"] = P1Captor.DataReaded.gasReceived5min;
-
-  serializeJson(doc, str);
+  // written in the buffer shared with MQTT : up to ~2 KB with the four M-Bus channels and the history of the peaks
+  JsonWriter json(JsonWriter::SharedBuffer, JSONBUFFERSIZE);
+  char value[11];
+  const P1Reader::DataP1 &data = P1Captor.GetSnapshot();
+  json.Key(PSTR("LastSample"));
+  json.Text(data.P1timestamp);
+  json.Key(PSTR("Epoch"));
+  snprintf(value, sizeof(value), "%u", static_cast<unsigned int>(data.epoch));
+  json.Raw(value);
+  json.Key(PSTR("Sequence"));
+  snprintf(value, sizeof(value), "%u", static_cast<unsigned int>(data.sequence));
+  json.Raw(value);
+  json.Key(PSTR("NextUpdateIn"));
+  snprintf(value, sizeof(value), "%lu", P1Captor.GetnextUpdateTime() - millis());
+  json.Raw(value);
+
+  json.Key(PSTR("P1"));
+  json.Open();
+  for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+    if (!inJsonGroup(data, info, ""))
+    {
+      continue;
+    }
+    json.Key(info.json);
+    json.Field(data, info);
+  }
+
+  uint8_t gas = P1Reader::GasChannel(data);
+  if (gas != 0)
+  {
+    json.Key(PSTR("gasReceived5min"));
+    json.Field(data, P1Reader::GetFieldInfo(P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)));
+  }
+
+  // the fields of a group are not next to each other in P1_FIELDS : one object per group, at its first field
+  for (uint8_t first = 0; first < P1Reader::Field::Count; first++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(first);
+    char group[16];
+    strncpy_P(group, info.jsonGroup, sizeof(group) - 1);
+    group[sizeof(group) - 1] = '\0';
+    if (group[0] == '\0' || !inJsonGroup(data, info, group))
+    {
+      continue;
+    }
+    bool written = false;
+    for (uint8_t field = 0; field < first && !written; field++)
+    {
+      written = inJsonGroup(data, P1Reader::GetFieldInfo(field), group);
+    }
+    if (written)
+    {
+      continue;
+    }
+    json.Key(info.jsonGroup);
+    json.Open();
+    for (uint8_t field = first; field < P1Reader::Field::Count; field++)
+    {
+      P1Reader::FieldInfo member = P1Reader::GetFieldInfo(field);
+      if (!inJsonGroup(data, member, group))
+      {
+        continue;
+      }
+      json.Key(member.json);
+      json.Field(data, member);
+    }
+    json.Close();
+  }
+  json.Close();
 
+  if (json.End() == 0)
+  {
+    MainSendDebugPrintf("[HTTP] JSON longer than %d, not sent", JSONBUFFERSIZE);
+    server.send(500, "text/plain", "");
+    return;
+  }
   ActifCache(false);
-  server.send(200, "application/json", str);
+  server.send(200, "application/json", JsonWriter::SharedBuffer);
 }
 
 /// @brief Check and ask login to login
@@ -35,6 +35,7 @@
 #include "MQTT.h"
 #include "P1Reader.h"
 #include "LogP1Mgr.h"
+#include "JsonWriter.h"
 
 class HTTPMgr
 {
@@ -50,7 +51,7 @@ private:
   P1Reader &P1Captor;
   LogP1Mgr &LogP1;
   ESP8266WebServer server;
-  char HTMLBufferContent[4000];
+  char HTMLBufferContent[6200]; // page de configuration en français avec tous les champs remplis au maximum : ~6 KB
   bool ChekifAsAdmin();
   void SendWithHeaderFooter(const char *content_type, char *content, const char *header, bool refresh);
   char* nettoyerInputText(const char* inputText, size_t maxLen);
@@ -59,6 +60,7 @@ private:
   void handlePassword();
   void handleSetup();
   void handleRAW();
+  void handleRawHistory();
   void handleFactoryReset();
   void handleSetupSave();
   void handleUploadForm();
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JsonWriter.h"
+
+char JsonWriter::SharedBuffer[JSONBUFFERSIZE];
+
+JsonWriter::JsonWriter(char *buffer, size_t size) : buffer(buffer), size(size)
+{
+  raw("{", 1);
+}
+
+void JsonWriter::Key(PGM_P key)
+{
+  if (!first)
+  {
+    raw(",", 1);
+  }
+  first = false;
+  raw("\"", 1);
+  size_t len = strlen_P(key);
+  if (room(len))
+  {
+    memcpy_P(buffer + pos, key, len);
+    pos += len;
+  }
+  raw("\":", 2);
+}
+
+void JsonWriter::Text(const char *value)
+{
+  raw("\"", 1);
+  for (; *value != '\0'; value++)
+  {
+    char c = *value;
+    if (c == '"' || c == '\\')
+    {
+      char escaped[2] = {'\\', c};
+      raw(escaped, 2);
+    }
+    else if (static_cast<uint8_t>(c) < 0x20)
+    {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      raw(escaped, 6);
+    }
+    else
+    {
+      raw(&c, 1);
+    }
+  }
+  raw("\"", 1);
+}
+
+void JsonWriter::Raw(const char *value)
+{
+  raw(value, strlen(value));
+}
+
+void JsonWriter::Field(const P1Reader::DataP1 &data, const P1Reader::FieldInfo &info)
+{
+  const char *text = P1Reader::FieldText(data, info);
+  if (text != nullptr)
+  {
+    Text(text);
+    return;
+  }
+  if (overflow)
+  {
+    return;
+  }
+  // FieldToChars cuts the value to the room left : a value that fills it (null included) may have been cut
+  size_t len = P1Reader::FieldToChars(data, info, buffer + pos, size - pos);
+  if (room(len + 2))
+  {
+    pos += len;
+  }
+}
+
+void JsonWriter::Open()
+{
+  raw("{", 1);
+  first = true;
+}
+
+void JsonWriter::Close()
+{
+  raw("}", 1);
+  first = false;
+}
+
+size_t JsonWriter::End()
+{
+  raw("}", 1);
+  if (overflow || !room(1))
+  {
+    return 0;
+  }
+  buffer[pos] = '\0';
+  return pos;
+}
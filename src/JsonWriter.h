@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <Arduino.h>
+#include "P1Reader.h"
+
+#define JSONBUFFERSIZE 4096 // P1.json and the MQTT document : ~1.5 KB for a meter with gas, up to ~3.6 KB with the four M-Bus channels, the peaks and the failures
+
+/// @brief JSON object written in a fixed buffer, without allocation
+class JsonWriter
+{
+public:
+  JsonWriter(char *buffer, size_t size);
+
+  /// @brief Buffer shared by the documents of the snapshot (P1.json, MQTT) : they are written and sent one at a time, from loop()
+  static char SharedBuffer[JSONBUFFERSIZE];
+
+  /// @param key name in PROGMEM
+  void Key(PGM_P key);
+
+  /// @brief Text value, escaped
+  void Text(const char *value);
+
+  /// @brief Value already in JSON : number, array
+  void Raw(const char *value);
+
+  /// @brief Value of a field of the datagram : the texts are escaped from the snapshot, the numbers and the lists are written in place
+  void Field(const P1Reader::DataP1 &data, const P1Reader::FieldInfo &info);
+
+  /// @brief Object as value of the last Key(), until Close()
+  void Open();
+  void Close();
+
+  /// @brief Close the document
+  /// @return length of the document, 0 if it was longer than the buffer
+  size_t End();
+
+private:
+  char *buffer;
+  size_t size;
+  size_t pos = 0;
+  bool first = true; // no key yet in the current object
+  bool overflow = false;
+
+  bool room(size_t len)
+  {
+    overflow |= (pos + len > size);
+    return !overflow;
+  }
+
+  void raw(const char *text, size_t len)
+  {
+    if (room(len))
+    {
+      memcpy(buffer + pos, text, len);
+      pos += len;
+    }
+  }
+};
+#endif
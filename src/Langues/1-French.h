@@ -64,8 +64,24 @@
 #define LANG_ConfMQTTUsr "Utilisateur MQTT"
 #define LANG_ConfMQTTPSW "Mot de passe MQTT"
 #define LANG_ConfMQTTRoot "Rubrique racine MQTT"
+#define LANG_ConfMQTTJson "Un seul JSON (topic /reading)"
+#define LANG_ConfMQTTDiscovery "Découverte Home Assistant"
+#define LANG_ConfMQTTPolicy "QoS (0 à 2) et retain par type de topic"
+#define LANG_ConfMQTTLive "Mesures instantanées"
+#define LANG_ConfMQTTCounter "Index cumulés"
+#define LANG_ConfMQTTState "État du module"
+#define LANG_ConfMQTTLogging "Debug"
 #define LANG_ConfReadP1Intr "Intervalle de mesure en sec"
 #define LANG_ConfPERMUTTARIF "Inverser heure creuse/pleine"
+#define LANG_ConfTariffAuto "Auto (selon le compteur)"
+#define LANG_ConfTariffNormal "Non"
+#define LANG_ConfTariffInverse "Oui"
+#define LANG_ConfContinuous "Lecture continue (un datagramme par seconde, DSMR5)"
+#define LANG_ConfP1Key "Clé de déchiffrement (Smarty)"
+#define LANG_ConfDecimation "Transmettre 1 datagramme sur"
+#define LANG_ConfLogDecimation "Historique 24h : 1 datagramme sur"
+#define LANG_ConfOnlyChanged "MQTT/Domoticz : envoyer seulement les valeurs modifiées"
+#define LANG_ConfFullRefresh "Renvoi complet toutes les (sec, 0 = jamais)"
 #define LANG_ConfTLNETH2 "Paramètres Telnet"
 #define LANG_ConfTLNETBool "Activer le port Telnet (23)"
 #define LANG_ConfTLNETDBG "Debug via Telnet ?"
@@ -64,8 +64,24 @@
 #define LANG_ConfMQTTUsr "MQTT user"
 #define LANG_ConfMQTTPSW "MQTT password"
 #define LANG_ConfMQTTRoot "MQTT root topic"
+#define LANG_ConfMQTTJson "Single JSON (topic /reading)"
+#define LANG_ConfMQTTDiscovery "Home Assistant discovery"
+#define LANG_ConfMQTTPolicy "QoS (0 to 2) and retain per kind of topic"
+#define LANG_ConfMQTTLive "Live readings"
+#define LANG_ConfMQTTCounter "Cumulative counters"
+#define LANG_ConfMQTTState "Module state"
+#define LANG_ConfMQTTLogging "Debug"
 #define LANG_ConfReadP1Intr "Measurement interval (sec)"
 #define LANG_ConfPERMUTTARIF "Reverse peak/off-peak"
+#define LANG_ConfTariffAuto "Auto (from the meter)"
+#define LANG_ConfTariffNormal "No"
+#define LANG_ConfTariffInverse "Yes"
+#define LANG_ConfContinuous "Continuous read (one telegram per second, DSMR5)"
+#define LANG_ConfP1Key "Decryption key (Smarty)"
+#define LANG_ConfDecimation "Send 1 telegram out of"
+#define LANG_ConfLogDecimation "24h history: 1 telegram out of"
+#define LANG_ConfOnlyChanged "MQTT/Domoticz: send only changed values"
+#define LANG_ConfFullRefresh "Full refresh every (sec, 0 = never)"
 #define LANG_ConfTLNETH2 "Telnet settings"
 #define LANG_ConfTLNETBool "Enable Telnet port (23)"
 #define LANG_ConfTLNETDBG "Debug via Telnet?"
@@ -64,8 +64,24 @@
 #define LANG_ConfMQTTUsr "MQTT-gebruiker"
 #define LANG_ConfMQTTPSW "MQTT-wachtwoord"
 #define LANG_ConfMQTTRoot "MQTT-hoofdonderwerp"
+#define LANG_ConfMQTTJson "Eén JSON (topic /reading)"
+#define LANG_ConfMQTTDiscovery "Home Assistant discovery"
+#define LANG_ConfMQTTPolicy "QoS (0 tot 2) en retain per soort topic"
+#define LANG_ConfMQTTLive "Momentane waarden"
+#define LANG_ConfMQTTCounter "Cumulatieve tellers"
+#define LANG_ConfMQTTState "Modulestatus"
+#define LANG_ConfMQTTLogging "Debug"
 #define LANG_ConfReadP1Intr "Meetinterval in seconden"
 #define LANG_ConfPERMUTTARIF "Peak/off-peak wisselen"
+#define LANG_ConfTariffAuto "Auto (volgens de meter)"
+#define LANG_ConfTariffNormal "Nee"
+#define LANG_ConfTariffInverse "Ja"
+#define LANG_ConfContinuous "Continu uitlezen (één telegram per seconde, DSMR5)"
+#define LANG_ConfP1Key "Decryptiesleutel (Smarty)"
+#define LANG_ConfDecimation "Verstuur 1 telegram op"
+#define LANG_ConfLogDecimation "24u-historiek: 1 telegram op"
+#define LANG_ConfOnlyChanged "MQTT/Domoticz: alleen gewijzigde waarden versturen"
+#define LANG_ConfFullRefresh "Volledige verzending elke (sec, 0 = nooit)"
 #define LANG_ConfTLNETH2 "Telnet-instellingen"
 #define LANG_ConfTLNETBool "Telnet-poort activeren (23)"
 #define LANG_ConfTLNETDBG "Debug via Telnet?"
@@ -25,6 +25,7 @@
 #define LOGP1MGR_H
 
 #define FILENAME_LAST24H "/Last24H.json"
+#define FILENAME_POWERFAILURES "/PowerFailures.json"
 #define MAX_POINTS 24
 
 #include <LittleFS.h>
@@ -50,24 +51,74 @@ public:
       format();
     }
     MainSendDebug("[STRG] Ready");
+    loadPowerFailures();
 
     // Écoute de nouveau datagram
-    DataReaderP1.OnNewDatagram([this]()
-                               { newDataGram(); });
-  }
-
-  /// @brief Conversion optimisée d'une chaîne numérique en uint8_t
-  /// @param str Valeur à convertir (2 caractères max)
-  /// @return une valeur numérique non signée
-  static inline uint8_t fastParseUint8(const char *str)
-  {
-    return (str[0] - '0') * 10 + (str[1] - '0');
+    DataReaderP1.OnNewDatagram([this](uint64_t)
+                               { newDataGram(); }, currentConf.logDecimation);
   }
 
 private:
   P1Reader &DataReaderP1;
   bool FileInitied = false;
-  uint8_t LastHourInLast24H = 0;
+  uint32_t LastHourInLast24H = 0; // heure UTC (epoch / 3600) : pas de doublon ni de trou au changement d'heure
+  P1Reader::PowerFailureLog SavedPowerFailures = {};
+
+  /// @brief Recharge le journal des pannes de courant sauvé avant le redémarrage
+  void loadPowerFailures()
+  {
+    File file = LittleFS.open(FILENAME_POWERFAILURES, "r");
+    if (!file)
+      return;
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error)
+    {
+      MainSendDebugPrintf("[STKG] JSON parse error: %s", error.c_str());
+      return;
+    }
+
+    for (JsonObject event : doc.as<JsonArray>())
+    {
+      P1Reader::PowerFailure failure = {};
+      failure.end = strtoull(event["end"] | "0", nullptr, 10);
+      failure.duration = event["duration"] | 0;
+      SavedPowerFailures.Add(failure);
+    }
+    DataReaderP1.RestorePowerFailures(SavedPowerFailures);
+  }
+
+  /// @brief Sauve le journal des pannes de courant s'il contient une nouvelle panne
+  void savePowerFailures(const P1Reader::DataP1 &data)
+  {
+    const P1Reader::PowerFailureLog &log = data.longPowerFailuresLog;
+    bool same = (log.count == SavedPowerFailures.count);
+    for (uint8_t n = 0; same && n < log.count; n++)
+    {
+      same = (log.event[n].end == SavedPowerFailures.event[n].end && log.event[n].duration == SavedPowerFailures.event[n].duration);
+    }
+    if (same)
+    {
+      return;
+    }
+
+    MainSendDebug("[STKG] Write power failures");
+    char json[P1FIELDMAXCHARS];
+    P1Reader::FieldToChars(data, P1Reader::GetFieldInfo(P1Reader::Field::longPowerFailuresLog), json, sizeof(json));
+    File file = LittleFS.open(FILENAME_POWERFAILURES, "w");
+    if (file)
+    {
+      file.print(json);
+      file.close();
+      SavedPowerFailures = log;
+    }
+    else
+    {
+      MainSendDebug("[STKG] Error: Cannot write file");
+    }
+  }
 
   /// @brief Charge seulement la dernière heure du fichier JSON
   /// @return True si succès
@@ -82,15 +133,13 @@ private:
     String content = file.readString();
     file.close();
 
-    int lastDateTime = content.lastIndexOf("\"DateTime\":\"");
+    int lastDateTime = content.lastIndexOf("\"DateTime\":");
     if (lastDateTime != -1)
     {
-      int startPos = lastDateTime + 12; // Longueur de "DateTime":""
-      if (startPos + 6 < (int)content.length())
-      {
-        LastHourInLast24H = fastParseUint8(content.c_str() + startPos + 6);
-        return true;
-      }
+      // epoch UTC, 0 pour l'ancien format (texte YYMMDDhhmmss) : une nouvelle ligne sera écrite
+      uint32_t epoch = strtoul(content.c_str() + lastDateTime + 11, nullptr, 10); // Longueur de "DateTime":
+      LastHourInLast24H = epoch / 3600;
+      return epoch != 0;
     }
     return false;
   }
@@ -98,7 +147,14 @@ private:
   /// @brief Traitement d'une nouvelle mesure reçue
   void newDataGram()
   {
-    uint8_t currentHour = fastParseUint8(&DataReaderP1.DataReaded.P1timestamp[6]);
+    savePowerFailures(DataReaderP1.GetSnapshot());
+
+    uint32_t epoch = DataReaderP1.GetSnapshot().epoch;
+    if (epoch == 0)
+    {
+      return; // pas d'heure dans le datagramme
+    }
+    uint32_t currentHour = epoch / 3600;
 
     if (!FileInitied)
     {
@@ -152,12 +208,31 @@ private:
     }
 
     // Ajouter le nouveau point avec la syntaxe moderne
+    const P1Reader::DataP1 &data = DataReaderP1.GetSnapshot();
+    char value[21]; // copied by serialized() (char*)
+    auto fixed = [&value](const P1Reader::FixedValue &metric)
+    {
+      metric.toChars(value, sizeof(value));
+      return serialized(value);
+    };
     JsonObject point = array.add<JsonObject>();
-    point["DateTime"] = DataReaderP1.DataReaded.P1timestamp;
-    point["T1"] = DataReaderP1.DataReaded.electricityUsedTariff1.val();
-    point["T2"] = DataReaderP1.DataReaded.electricityUsedTariff2.val();
-    point["R1"] = DataReaderP1.DataReaded.electricityReturnedTariff1.val();
-    point["R2"] = DataReaderP1.DataReaded.electricityReturnedTariff2.val();
+    point["DateTime"] = data.epoch;
+    point["T1"] = fixed(data.electricityUsedTariff1);
+    point["T2"] = fixed(data.electricityUsedTariff2);
+    point["R1"] = fixed(data.electricityReturnedTariff1);
+    point["R2"] = fixed(data.electricityReturnedTariff2);
+
+    // Compteurs M-Bus (gaz, eau, chaleur) présents : M1 à M4
+    char name[3] = "M0";
+    for (uint8_t channel = 1; channel <= P1MBUSCHANNELS; channel++)
+    {
+      if (P1Reader::MBusPresent(data, channel))
+      {
+        P1Reader::FieldToChars(data, P1Reader::GetFieldInfo(P1Reader::MBusField(channel, P1Reader::Field::mbus1Value)), value, sizeof(value));
+        name[1] = '0' + channel;
+        point[name] = serialized(value);
+      }
+    }
 
     // Sauvegarder atomiquement
     File outFile = LittleFS.open(FILENAME_LAST24H, "w");
@@ -24,9 +24,12 @@
  */
 
 #include <MQTT.h>
+#include "JsonWriter.h"
 
 MQTTMgr::MQTTMgr(settings &currentConf, WifiMgr &currentLink, P1Reader &currentP1) : conf(currentConf), WifiClient(currentLink), DataReaderP1(currentP1)
 {
+  buildTopics(); // the settings only change with a restart
+
   mqtt_connect();
 
   WifiClient.OnWifiEvent([this](bool b, wl_status_t s1, wl_status_t s2)
@@ -39,10 +42,10 @@ MQTTMgr::MQTTMgr(settings &currentConf, WifiMgr &currentLink, P1Reader &currentP
     }
   });
 
-  DataReaderP1.OnNewDatagram([this]()
+  ReporterId = DataReaderP1.OnNewDatagram([this](uint64_t changed)
   {
-    MQTT_reporter();
-  });
+    MQTT_reporter(changed);
+  }, conf.mqttDecimation, true);
 
   // Configuration des callbacks MQTT
   mqtt_client.onConnect([this](bool sessionPresent)
@@ -78,11 +81,13 @@ void MQTTMgr::onMqttConnect(bool sessionPresent)
   _state = CONNECTED;
   CountError = 0;
   MainSendDebug("[MQTT] connected");
+  DataReaderP1.RequestFullReport(ReporterId); // the broker may have lost the retained topics
 
   // Once connected, publish an announcement...
-  send_char("State/status", "running");
-  send_char("State/Version", VERSION);
-  send_char("State/IP", WifiClient.CurrentIP().c_str());
+  send_char(TopicStatus, "running", MQTT_STATE);
+  send_char(TopicVersion, VERSION, MQTT_STATE);
+  send_char(TopicIP, WifiClient.CurrentIP().c_str(), MQTT_STATE);
+  DiscoveryNeeded = conf.mqttDiscovery; // Home Assistant : with the next datagram, see startDiscovery()
 }
 
 bool MQTTMgr::IsConnected()
@@ -92,7 +97,7 @@ bool MQTTMgr::IsConnected()
 
 void MQTTMgr::stop()
 {
-  send_char("State/status", "stopping");
+  send_char(TopicStatus, "stopping", MQTT_STATE);
 }
 
 bool MQTTMgr::mqtt_connect()
@@ -124,34 +129,82 @@ bool MQTTMgr::mqtt_connect()
 }
 
 
-void MQTTMgr::send_float(String name, float metric) // added *long
+/// @brief Name of each topic that is not a field (see Topic)
+static const char TopicNames[] PROGMEM = "equipmentName\0State/status\0State/Version\0State/IP\0State/Logging\0consumption/gas/delivered\0meter-stats/crc_errors\0reading\0backlog\0";
+
+/// @brief Write all the topics one after the other in a single block, sized in a first pass
+void MQTTMgr::buildTopics()
 {
-  char value[20];
-  dtostrf(metric, 3, 3, value);
+  size_t prefix = strlen(conf.mqttTopic);
+  PGM_P names[TopicCount];
+  size_t size = 0;
+
+  PGM_P extra = TopicNames;
+  for (uint8_t id = 0; id < TopicCount; id++)
+  {
+    if (id < P1Reader::Field::Count)
+    {
+      names[id] = P1Reader::GetFieldInfo(id).mqtt;
+      if (conf.mqttJson || pgm_read_byte(names[id]) == '\0')
+      {
+        names[id] = nullptr; // a single document on TopicReading, or no topic for this field
+        continue;
+      }
+    }
+    else
+    {
+      names[id] = extra;
+      extra += strlen_P(extra) + 1;
+    }
+    size += prefix + 1 + strlen_P(names[id]) + 1;
+  }
 
-  String mtopic = String(conf.mqttTopic) + "/" + name;
-  send_msg(mtopic.c_str(), value); // output
+  Topics.reset(new char[size]);
+  size_t pos = 0;
+  for (uint8_t id = 0; id < TopicCount; id++)
+  {
+    if (names[id] == nullptr)
+    {
+      TopicOffset[id] = MQTTNOTOPIC;
+      continue;
+    }
+    TopicOffset[id] = pos;
+    memcpy(Topics.get() + pos, conf.mqttTopic, prefix);
+    pos += prefix;
+    Topics[pos++] = '/';
+    strcpy_P(Topics.get() + pos, names[id]);
+    pos += strlen(Topics.get() + pos) + 1;
+  }
+  MainSendDebugPrintf("[MQTT] %u bytes of topics", static_cast<unsigned>(size));
 }
 
-void MQTTMgr::send_char(String name, const char *metric)
+void MQTTMgr::send_char(uint8_t topicId, const char *metric, uint8_t topicClass)
 {
-  String mtopic = String(conf.mqttTopic) + "/" + name;
-  send_msg(mtopic.c_str(), metric);
+  const char *name = topic(topicId);
+  if (name == nullptr)
+  {
+    return; // field without topic
+  }
+  send_msg(name, metric, topicClass);
 }
 
-void MQTTMgr::send_uint32_t(String name, uint32_t metric)
+void MQTTMgr::send_uint32_t(uint8_t topicId, uint32_t metric, uint8_t topicClass)
 {
+  const char *name = topic(topicId);
+  if (name == nullptr)
+  {
+    return; // field without topic
+  }
   char value_buffer[11];  // uint32_t max = 4294967295 (10 chiffres + \0)
   uint32ToChar(metric, value_buffer);
-
-  String mtopic = String(conf.mqttTopic) + "/" + name;
-  send_msg(mtopic.c_str(), value_buffer);
+  send_msg(name, value_buffer, topicClass);
 }
 
 /// @brief Send a message to a broker topic
 /// @param topic 
 /// @param payload 
-void MQTTMgr::send_msg(const char *topic, const char *payload)
+/// @param topicClass QoS and retain of this class of topic (MQTT_LIVE, ...)
+void MQTTMgr::send_msg(const char *topic, const char *payload, uint8_t topicClass)
 {
     if (!mqtt_client.connected())
     {
@@ -162,7 +215,7 @@ void MQTTMgr::send_msg(const char *topic, const char *payload)
     {
       return; //nothing to report
     }
-    mqtt_client.publish(topic, 2, true, payload);
+    mqtt_client.publish(topic, conf.mqttQoS[topicClass], conf.mqttRetain[topicClass], payload);
 }
 
 char* MQTTMgr::uint32ToChar(uint32_t value, char* buffer)
@@ -203,56 +256,344 @@ void MQTTMgr::SendDebug(String payload)
 {
   if (conf.debugToMqtt && mqtt_client.connected())
   {
-    char charArray[payload.length() + 1]; // +1 pour le caractère nul
-    payload.toCharArray(charArray, sizeof(charArray));
-    charArray[sizeof(charArray) - 1] = '\0';
-    send_char("State/Logging", charArray);
+    send_char(TopicLogging, payload.c_str(), MQTT_LOGGING);
   }
 }
 
-void MQTTMgr::MQTT_reporter()
+/// @brief Class of the topic of a value, from its type and its unit
+uint8_t MQTTMgr::fieldClass(const P1Reader::FieldInfo &info)
 {
-  if (!DataReaderP1.dataEnd)
+  switch (info.type)
+  {
+  case P1Reader::OBISType::Fixed:
+    return (strcmp_P("kWh", info.unit) == 0) ? MQTT_COUNTER : MQTT_LIVE; // energy index or power, voltage, current
+  case P1Reader::OBISType::Tariff:
+    return MQTT_LIVE;
+  case P1Reader::OBISType::Text:
+  case P1Reader::OBISType::HexText:
+    return (info.obis == OBISKey(0, 0, 1, 0, 0)) ? MQTT_LIVE : MQTT_STATE; // time of the datagram, or identification, version, message
+  default:
+    return MQTT_COUNTER; // M-Bus readings and their time, counts, peaks, failures
+  }
+}
+
+void MQTTMgr::MQTT_reporter(uint64_t changedFields)
+{
+  if (DataReaderP1.GetSnapshot().sequence == 0)
   {
     //Pas de donnée valide a envoyer
     return;
   }
 
+  const P1Reader::DataP1 &data = DataReaderP1.GetSnapshot();
+  if (!mqtt_client.connected())
+  {
+    // not lost : kept in flash and sent once connected
+    if (!Queuing)
+    {
+      MainSendDebug("[MQTT] Broker unreachable, readings queued");
+      Queuing = true;
+    }
+    Queue.Add(data);
+    mqtt_connect();
+    return;
+  }
+  Queuing = false;
+  sendQueue();
+  if (DiscoveryNeeded)
+  {
+    DiscoveryNeeded = false;
+    startDiscovery(data);
+  }
+  sendDiscovery(data);
+
   MainSendDebug("[MQTT] Send P1 data");
+  if (conf.mqttJson)
+  {
+    sendJson(data);
+    return;
+  }
+
+  // Topics are retained : only the changed values are sent, with a full refresh from time to time (see P1Reader::OnNewDatagram)
+  bool full = (changedFields == P1Reader::AllFields);
+  auto changed = [changedFields](uint8_t field)
+  {
+    return ((changedFields >> field) & 1) != 0;
+  };
 
   //no DSMR valid :
-  send_char("equipmentName", DataReaderP1.meterName.c_str());
-
-  send_char("equipmentID", DataReaderP1.DataReaded.equipmentId);
-  send_char("reading/timestamp", DataReaderP1.DataReaded.P1timestamp);
-
-  send_float("reading/electricity_delivered_1", DataReaderP1.DataReaded.electricityUsedTariff1);
-  send_float("reading/electricity_delivered_2", DataReaderP1.DataReaded.electricityUsedTariff2);
-  send_float("reading/electricity_returned_1", DataReaderP1.DataReaded.electricityReturnedTariff1);
-  send_float("reading/electricity_returned_2", DataReaderP1.DataReaded.electricityReturnedTariff2);
-  send_float("reading/electricity_currently_delivered", DataReaderP1.DataReaded.actualElectricityPowerDeli);
-  send_float("reading/electricity_currently_returned", DataReaderP1.DataReaded.actualElectricityPowerRet);
-
-  send_float("reading/phase_currently_delivered_l1", DataReaderP1.DataReaded.activePowerL1P);
-  send_float("reading/phase_currently_delivered_l2", DataReaderP1.DataReaded.activePowerL2P);
-  send_float("reading/phase_currently_delivered_l3", DataReaderP1.DataReaded.activePowerL3P);
-  send_float("reading/phase_currently_returned_l1", DataReaderP1.DataReaded.activePowerL1NP);
-  send_float("reading/phase_currently_returned_l2", DataReaderP1.DataReaded.activePowerL2NP);
-  send_float("reading/phase_currently_returned_l3", DataReaderP1.DataReaded.activePowerL3NP);
-  send_float("reading/phase_voltage_l1", DataReaderP1.DataReaded.instantaneousVoltageL1);
-  send_float("reading/phase_voltage_l2", DataReaderP1.DataReaded.instantaneousVoltageL2);
-  send_float("reading/phase_voltage_l3", DataReaderP1.DataReaded.instantaneousVoltageL3);
-
-  send_char("consumption/gas/delivered", DataReaderP1.DataReaded.gasReceived5min);
-  
-  send_char("meter-stats/dsmr_version", DataReaderP1.DataReaded.P1version);
-  send_uint32_t("meter-stats/electricity_tariff", DataReaderP1.DataReaded.tariffIndicatorElectricity);
-  send_uint32_t("meter-stats/power_failure_count", DataReaderP1.DataReaded.numberLongPowerFailuresAny);
-  send_uint32_t("meter-stats/long_power_failure_count", DataReaderP1.DataReaded.numberLongPowerFailuresAny);
-  send_uint32_t("meter-stats/short_power_drops", DataReaderP1.DataReaded.numberVoltageSagsL1);
-  send_uint32_t("meter-stats/short_power_peaks", DataReaderP1.DataReaded.numberVoltageSwellsL1);
+  if (full) send_char(TopicEquipmentName, DataReaderP1.meterName.c_str(), MQTT_STATE);
+
+  // the texts are sent from the snapshot, the numbers and the lists are written in the shared buffer (publish copies the payload)
+  char *value = JsonWriter::SharedBuffer;
+  for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+    if (TopicOffset[field] == MQTTNOTOPIC || !changed(field) || !P1Reader::FieldPresent(data, info))
+    {
+      continue;
+    }
+    const char *text = P1Reader::FieldText(data, info);
+    if (text == nullptr)
+    {
+      P1Reader::FieldToChars(data, info, value, JSONBUFFERSIZE);
+      text = value;
+    }
+    send_char(field, text, fieldClass(info));
+  }
+
+  // gas reading also on its historical topic
+  uint8_t gas = P1Reader::GasChannel(data);
+  if (gas != 0 && changed(P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)))
+  {
+    P1Reader::FieldToChars(data, P1Reader::GetFieldInfo(P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)), value, JSONBUFFERSIZE);
+    send_char(TopicGas, value, MQTT_COUNTER);
+  }
+  if (full || DataReaderP1.crcErrors != LastCRCErrors) send_uint32_t(TopicCRCErrors, DataReaderP1.crcErrors, MQTT_COUNTER);
+  LastCRCErrors = DataReaderP1.crcErrors;
 
   LastReportinMillis = millis();
 
   return;
-}
\ No newline at end of file
+}
+
+/// @brief Send the next readings of the queue on <mqttTopic>/backlog, MQTTQUEUEBURST per datagram, with the time of their datagram :
+/// {"epoch":1735689600,"reading/electricity_delivered_1":1.234,...,"consumption/gas/delivered":5.678}
+/// Not retained : the topics of the values keep the current reading.
+void MQTTMgr::sendQueue()
+{
+  MQTTQueue::Record records[MQTTQUEUEBURST];
+  uint8_t count = Queue.Peek(records, MQTTQUEUEBURST);
+  if (count == 0)
+  {
+    return;
+  }
+
+  char json[448]; // ~340 chars for a record, up to 404 with the longest values
+  char value[21];
+  uint8_t sent = 0;
+  for (uint8_t n = 0; n < count; n++, sent++)
+  {
+    JsonWriter writer(json, sizeof(json));
+    writer.Key(PSTR("epoch"));
+    writer.Raw(uint32ToChar(records[n].epoch, value));
+    for (uint8_t field = 0; field < MQTTQUEUEVALUES; field++)
+    {
+      if (records[n].value[field] != MQTTQUEUENOVALUE)
+      {
+        P1Reader::FixedValue::FromMilli(records[n].value[field]).toChars(value, sizeof(value));
+        writer.Key(MQTTQueue::Key(field));
+        writer.Raw(value);
+      }
+    }
+    // a record too long for json[] is dropped, a record not published stays in the queue for the next datagram
+    if (writer.End() != 0 && !mqtt_client.publish(topic(TopicBacklog), conf.mqttQoS[MQTT_COUNTER], false, json))
+    {
+      break;
+    }
+  }
+  Queue.Consume(sent);
+  if (Queue.Empty())
+  {
+    MainSendDebug("[MQTT] Queue sent");
+  }
+}
+
+/// @brief Whole snapshot in one JSON document on <mqttTopic>/reading : one message per datagram instead of one per value.
+/// The keys are the topics of the mode per topic, ex: {"equipmentName":"...","reading/electricity_delivered_1":1.234,...}
+void MQTTMgr::sendJson(const P1Reader::DataP1 &data)
+{
+  JsonWriter json(JsonWriter::SharedBuffer, JSONBUFFERSIZE);
+  char value[11];
+
+  json.Key(PSTR("equipmentName"));
+  json.Text(DataReaderP1.meterName.c_str());
+  for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+    if (pgm_read_byte(info.mqtt) == '\0' || !P1Reader::FieldPresent(data, info))
+    {
+      continue;
+    }
+    json.Key(info.mqtt);
+    json.Field(data, info);
+  }
+
+  uint8_t gas = P1Reader::GasChannel(data);
+  if (gas != 0)
+  {
+    json.Key(PSTR("consumption/gas/delivered"));
+    json.Field(data, P1Reader::GetFieldInfo(P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)));
+  }
+  json.Key(PSTR("meter-stats/crc_errors"));
+  json.Raw(uint32ToChar(DataReaderP1.crcErrors, value));
+
+  if (json.End() == 0)
+  {
+    MainSendDebugPrintf("[MQTT] JSON longer than %d, not sent", JSONBUFFERSIZE);
+    return;
+  }
+  send_char(TopicReading, JsonWriter::SharedBuffer, MQTT_COUNTER); // the only copy of the index : as the counters
+  LastReportinMillis = millis();
+}
+
+/// @brief Classes of Home Assistant of the units of P1_FIELDS
+struct DiscoveryUnit
+{
+  char unit[4];
+  char deviceClass[8];
+  char stateClass[17];
+};
+static const DiscoveryUnit DiscoveryUnits[] PROGMEM = {
+    {"kWh", "energy", "total_increasing"},
+    {"kW", "power", "measurement"},
+    {"V", "voltage", "measurement"},
+    {"A", "current", "measurement"},
+    {"m³", "gas", "total_increasing"}}; // reading of the gas meter (the M-Bus fields have no unit)
+#define DISCOVERY_GAS 4
+
+static const char DiscoveryTopic[] PROGMEM = "homeassistant/sensor/%s/%s/config";
+static const char DiscoveryConfig[] PROGMEM = R"({"name":"%s","uniq_id":"%s_%s","stat_t":"%s",%s%s"dev":{"ids":["%s"],"name":"%s","mf":"narfight","mdl":"P1 Wi-Fi Gateway","sw":")" VERSION R"("}})";
+static const char DiscoveryClass[] PROGMEM = R"("dev_cla":"%s","stat_cla":"%s","unit_of_meas":"%s",)";
+static const char DiscoveryValue[] PROGMEM = R"("val_tpl":"{{value_json['%s']}}",)";
+
+/// @brief Hash FNV-1a of a text, continued from the hash of the previous texts
+static uint32_t fnv1a(uint32_t hash, const char *text)
+{
+  for (; *text != '\0'; text++)
+  {
+    hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619UL;
+  }
+  return hash;
+}
+
+/// @brief Write the config of a sensor for Home Assistant in DiscoveryBuffer, from the description of its field
+/// @param id field, or Field::Count for the gas (topic consumption/gas/delivered)
+/// @param configTopic out: topic of the config
+/// @return length of the config, 0 if the field is not a sensor (no topic, JSON array, M-Bus channel not present) or if it is too long
+size_t MQTTMgr::discoveryConfig(const P1Reader::DataP1 &data, uint8_t id, char *configTopic, size_t topicSize)
+{
+  char name[32];
+  char key[48];
+  uint8_t stateTopic = id;
+  DiscoveryUnit sensor = {};
+
+  if (id == P1Reader::Field::Count)
+  {
+    if (P1Reader::GasChannel(data) == 0)
+    {
+      return 0;
+    }
+    strcpy(name, "gasDelivered");
+    strcpy(key, "consumption/gas/delivered");
+    stateTopic = TopicGas;
+    memcpy_P(&sensor, &DiscoveryUnits[DISCOVERY_GAS], sizeof(sensor));
+  }
+  else
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(id);
+    if (pgm_read_byte(info.mqtt) == '\0' || info.type == P1Reader::OBISType::Peaks || info.type == P1Reader::OBISType::Failures || !P1Reader::FieldPresent(data, info))
+    {
+      return 0;
+    }
+    strncpy_P(name, info.name, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    strncpy_P(key, info.mqtt, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    for (uint8_t n = 0; n < DISCOVERY_GAS && sensor.unit[0] == '\0'; n++)
+    {
+      memcpy_P(&sensor, &DiscoveryUnits[n], sizeof(sensor));
+      if (strcmp_P(sensor.unit, info.unit) != 0)
+      {
+        sensor = {}; // no class for the other units
+      }
+    }
+  }
+
+  char classes[96] = "";
+  if (sensor.unit[0] != '\0')
+  {
+    snprintf_P(classes, sizeof(classes), DiscoveryClass, sensor.deviceClass, sensor.stateClass, sensor.unit);
+  }
+  char value[80] = "";
+  if (conf.mqttJson)
+  {
+    snprintf_P(value, sizeof(value), DiscoveryValue, key); // a single document : the value is one of its keys
+    stateTopic = TopicReading;
+  }
+
+  if (topic(stateTopic) == nullptr)
+  {
+    return 0;
+  }
+  snprintf_P(configTopic, topicSize, DiscoveryTopic, GetClientName(), name);
+  int len = snprintf_P(DiscoveryBuffer.get(), MQTTDISCOVERYSIZE, DiscoveryConfig, name, GetClientName(), name, topic(stateTopic), classes, value, GetClientName(), GetClientName());
+  return (len > 0 && len < MQTTDISCOVERYSIZE) ? len : 0;
+}
+
+/// @brief Publish the configs for Home Assistant if they changed since the last time (hash in MQTTDISCOVERYFILE) :
+/// they are retained, there is no need to send them again at each connection. A change of topic, of mode (JSON),
+/// of firmware or of M-Bus device changes the hash.
+void MQTTMgr::startDiscovery(const P1Reader::DataP1 &data)
+{
+  DiscoveryBuffer.reset(new char[MQTTDISCOVERYSIZE]);
+  char configTopic[96];
+  uint32_t hash = 2166136261UL;
+  for (uint8_t id = 0; id <= P1Reader::Field::Count; id++)
+  {
+    if (discoveryConfig(data, id, configTopic, sizeof(configTopic)) != 0)
+    {
+      hash = fnv1a(fnv1a(hash, configTopic), DiscoveryBuffer.get());
+    }
+  }
+
+  File file = LittleFS.open(MQTTDISCOVERYFILE, "r");
+  uint32_t saved = file ? strtoul(file.readString().c_str(), nullptr, 16) : 0;
+  file.close();
+  if (saved == hash)
+  {
+    DiscoveryBuffer.reset();
+    MainSendDebug("[MQTT] Home Assistant discovery up to date");
+    return;
+  }
+
+  DiscoveryHash = hash;
+  DiscoveryNext = 0;
+}
+
+/// @brief Publish the next configs for Home Assistant, MQTTDISCOVERYBURST per datagram
+void MQTTMgr::sendDiscovery(const P1Reader::DataP1 &data)
+{
+  if (DiscoveryNext == MQTTDISCOVERYDONE)
+  {
+    return;
+  }
+
+  char configTopic[96];
+  for (uint8_t sent = 0; sent < MQTTDISCOVERYBURST && DiscoveryNext <= P1Reader::Field::Count; DiscoveryNext++)
+  {
+    if (discoveryConfig(data, DiscoveryNext, configTopic, sizeof(configTopic)) == 0)
+    {
+      continue;
+    }
+    if (mqtt_client.publish(configTopic, conf.mqttQoS[MQTT_STATE], true, DiscoveryBuffer.get()) == 0)
+    {
+      return; // queue of the client full : again at the next datagram
+    }
+    sent++;
+  }
+  if (DiscoveryNext <= P1Reader::Field::Count)
+  {
+    return;
+  }
+
+  File file = LittleFS.open(MQTTDISCOVERYFILE, "w");
+  if (file)
+  {
+    file.printf("%08x", static_cast<unsigned>(DiscoveryHash));
+    file.close();
+  }
+  DiscoveryNext = MQTTDISCOVERYDONE;
+  DiscoveryBuffer.reset();
+  MainSendDebug("[MQTT] Home Assistant discovery published");
+}
@@ -28,19 +28,28 @@
 
 #define MAXERROR 10
 #define RETRYTIME 10000
+#define MQTTNOTOPIC 0xFFFF
+#define MQTTDISCOVERYFILE "/HADiscovery.hash" // hash of the last configs published for Home Assistant
+#define MQTTDISCOVERYSIZE 640                 // one config of sensor : ~420 chars in JSON mode
+#define MQTTDISCOVERYBURST 8                  // configs published per datagram
+#define MQTTDISCOVERYDONE 0xFF
 
 #include <Arduino.h>
 #include "GlobalVar.h"
 #include <WiFiClient.h>
 #include <AsyncMqttClient.h>
+#include <memory>
 #include "Debug.h"
 #include "P1Reader.h"
+#include "MQTTQueue.h"
 #include "WifiMgr.h"
 
 class MQTTMgr
 {
 private:
   unsigned long LastReportinMillis = 0;
+  uint8_t ReporterId = 0; // consumer of P1Reader, see P1Reader::RequestFullReport()
+  uint32_t LastCRCErrors = 0;
   AsyncMqttClient mqtt_client; // * Initiate MQTT client
   settings &conf;
   WifiMgr &WifiClient;
@@ -50,8 +59,44 @@ private:
   /// @brief Send a message to a broker topic
   /// @param topic
   /// @param payload
-  void send_msg(const char *topic, const char *payload);
+  /// @param topicClass QoS and retain of this class of topic (MQTT_LIVE, ...)
+  void send_msg(const char *topic, const char *payload, uint8_t topicClass);
+  static uint8_t fieldClass(const P1Reader::FieldInfo &info);
+
+  /// @brief Topics that are not a field, indexed after the fields in TopicOffset
+  enum Topic : uint8_t
+  {
+    TopicEquipmentName = P1Reader::Field::Count,
+    TopicStatus,
+    TopicVersion,
+    TopicIP,
+    TopicLogging,
+    TopicGas,
+    TopicCRCErrors,
+    TopicReading,
+    TopicBacklog,
+    TopicCount
+  };
+  std::unique_ptr<char[]> Topics;    // all the topics "<mqttTopic>/<name>", built once : a publish doesn't allocate its topic
+  uint16_t TopicOffset[TopicCount];  // start of each topic in Topics, MQTTNOTOPIC if the field has no topic
+  void buildTopics();
+  /// @brief Topic of a field or of a Topic, nullptr if it has none (MQTTNOTOPIC)
+  const char *topic(uint8_t id) const
+  {
+    return (TopicOffset[id] == MQTTNOTOPIC) ? nullptr : Topics.get() + TopicOffset[id];
+  }
   char* uint32ToChar(uint32_t value, char* buffer);
+  void sendJson(const P1Reader::DataP1 &data);
+  MQTTQueue Queue; // readings of the datagrams received while the broker is unreachable
+  bool Queuing = false;
+  void sendQueue();
+  std::unique_ptr<char[]> DiscoveryBuffer; // MQTTDISCOVERYSIZE, only while the configs are published
+  uint8_t DiscoveryNext = MQTTDISCOVERYDONE; // next config to publish : field, then the gas
+  uint32_t DiscoveryHash = 0;
+  bool DiscoveryNeeded = false; // connected : check the configs with the next datagram (the M-Bus channels present are known)
+  void startDiscovery(const P1Reader::DataP1 &data);
+  void sendDiscovery(const P1Reader::DataP1 &data);
+  size_t discoveryConfig(const P1Reader::DataP1 &data, uint8_t id, char *configTopic, size_t topicSize);
   enum {
     CONNECTING,
     CONNECTED,
@@ -67,10 +112,9 @@ public:
   bool mqtt_connect();
   bool IsConnected();
 
-  void send_float(String name, float metric);
-  void send_char(String name, const char *metric);
-  void send_uint32_t(String name, uint32_t metric);
-  void MQTT_reporter();
+  void send_char(uint8_t topicId, const char *metric, uint8_t topicClass);
+  void send_uint32_t(uint8_t topicId, uint32_t metric, uint8_t topicClass);
+  void MQTT_reporter(uint64_t changedFields);
   void SendDebug(String payload);
 };
 #endif
\ No newline at end of file
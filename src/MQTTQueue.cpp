@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MQTTQueue.h"
+
+#define GAS_VALUE (MQTTQUEUEVALUES - 1) // last value : reading of the gas meter, on its channel
+
+/// @brief Fields of the values of a record, before the gas
+static const uint8_t QueuedFields[MQTTQUEUEVALUES - 1] PROGMEM = {
+    P1Reader::Field::electricityUsedTariff1,
+    P1Reader::Field::electricityUsedTariff2,
+    P1Reader::Field::electricityReturnedTariff1,
+    P1Reader::Field::electricityReturnedTariff2,
+    P1Reader::Field::actualElectricityPowerDeli,
+    P1Reader::Field::actualElectricityPowerRet};
+
+/// @brief Value of a field in milli-units (the indexes fit in 32 bits up to 2 147 483 kWh)
+static int32_t fieldValue(const P1Reader::DataP1 &data, uint8_t field)
+{
+  P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+  const P1Reader::FixedValue *value = reinterpret_cast<const P1Reader::FixedValue *>(reinterpret_cast<const uint8_t *>(&data) + info.offset);
+  return static_cast<int32_t>(value->int_val());
+}
+
+PGM_P MQTTQueue::Key(uint8_t n)
+{
+  if (n == GAS_VALUE)
+  {
+    return PSTR("consumption/gas/delivered");
+  }
+  return P1Reader::GetFieldInfo(pgm_read_byte(&QueuedFields[n])).mqtt;
+}
+
+void MQTTQueue::Add(const P1Reader::DataP1 &data)
+{
+  if (data.epoch == 0 || data.epoch - lastEpoch < MQTTQUEUEINTERVAL)
+  {
+    return; // no time in the datagram, or the last record is too recent
+  }
+  lastEpoch = data.epoch;
+  pending = true;
+
+  Record record;
+  record.epoch = data.epoch;
+  for (uint8_t n = 0; n < GAS_VALUE; n++)
+  {
+    record.value[n] = fieldValue(data, pgm_read_byte(&QueuedFields[n]));
+  }
+  uint8_t gas = P1Reader::GasChannel(data);
+  record.value[GAS_VALUE] = (gas != 0) ? fieldValue(data, P1Reader::MBusField(gas, P1Reader::Field::mbus1Value)) : MQTTQUEUENOVALUE;
+
+  File file = LittleFS.open(MQTTQUEUEFILE, "a");
+  if (file && file.size() >= MQTTQUEUESIZE)
+  {
+    // full : it becomes the previous file, the records not sent of the previous one are lost
+    file.close();
+    LittleFS.remove(MQTTQUEUEOLDFILE);
+    LittleFS.rename(MQTTQUEUEFILE, MQTTQUEUEOLDFILE);
+    sentPos = 0;
+    MainSendDebug("[MQTT] Queue full, oldest readings dropped");
+    file = LittleFS.open(MQTTQUEUEFILE, "a");
+  }
+  if (!file || file.write(reinterpret_cast<const uint8_t *>(&record), sizeof(record)) != sizeof(record))
+  {
+    MainSendDebug("[MQTT] Error: Cannot write queue");
+  }
+}
+
+uint8_t MQTTQueue::Peek(Record *records, uint8_t max)
+{
+  if (!pending)
+  {
+    return 0; // no access to the flash for each datagram
+  }
+  for (uint8_t attempt = 0; attempt < 2; attempt++)
+  {
+    if (!LittleFS.exists(MQTTQUEUEOLDFILE))
+    {
+      // the file in progress is sent now : the next records go to a new one
+      if (!LittleFS.exists(MQTTQUEUEFILE) || !LittleFS.rename(MQTTQUEUEFILE, MQTTQUEUEOLDFILE))
+      {
+        break;
+      }
+      sentPos = 0;
+    }
+
+    File file = LittleFS.open(MQTTQUEUEOLDFILE, "r");
+    size_t count = 0;
+    oldSize = file ? file.size() : 0;
+    if (file && file.seek(sentPos, SeekSet))
+    {
+      count = file.readBytes(reinterpret_cast<char *>(records), max * sizeof(Record)) / sizeof(Record);
+    }
+    file.close();
+
+    if (count > 0)
+    {
+      return count;
+    }
+    LittleFS.remove(MQTTQUEUEOLDFILE); // all sent (or not readable)
+  }
+  pending = false;
+  return 0;
+}
+
+void MQTTQueue::Consume(uint8_t count)
+{
+  sentPos += count * sizeof(Record);
+  if (count > 0 && sentPos + sizeof(Record) > oldSize)
+  {
+    LittleFS.remove(MQTTQUEUEOLDFILE); // all its records are sent
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MQTTQUEUE_H
+#define MQTTQUEUE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "Debug.h"
+#include "P1Reader.h"
+
+#define MQTTQUEUEFILE "/MQTTQueue.bin"    // records added now
+#define MQTTQUEUEOLDFILE "/MQTTQueue.old" // previous file, sent first
+#define MQTTQUEUESIZE 16384               // bytes per file (512 records) : with the two files, ~2h50 of readings kept
+#define MQTTQUEUEINTERVAL 10              // seconds between two records while the broker is unreachable
+#define MQTTQUEUEBURST 5                  // records sent per datagram once connected again : no burst on the broker
+#define MQTTQUEUEVALUES 7                 // indexes and power of electricity, gas
+#define MQTTQUEUENOVALUE INT32_MIN        // value not in the datagram
+
+/// @brief Readings kept in flash while the broker is unreachable, sent with their time once it is back.
+/// The records are appended to a file; when it is full it becomes the previous file, that replaces the older one
+/// (the oldest readings are dropped). A record is only written every MQTTQUEUEINTERVAL seconds to spare the flash.
+class MQTTQueue
+{
+public:
+  /// @brief Reading of a datagram, fixed size
+  struct Record
+  {
+    uint32_t epoch;                  // time of the datagram, UTC
+    int32_t value[MQTTQUEUEVALUES];  // milli-units (Wh, W, dm3), see Key()
+  };
+
+  /// @brief Add the reading of a datagram, if the last one is older than MQTTQUEUEINTERVAL
+  void Add(const P1Reader::DataP1 &data);
+
+  /// @brief Read the next records to send, oldest first. They stay in the queue until Consume().
+  /// @param records destination
+  /// @param max count of records wanted
+  /// @return count of records read, 0 if the queue is empty
+  uint8_t Peek(Record *records, uint8_t max);
+
+  /// @brief Remove from the queue the first records given by the last Peek(), once they are sent
+  /// @param count records sent, the others are given again by the next Peek()
+  void Consume(uint8_t count);
+
+  bool Empty()
+  {
+    return !LittleFS.exists(MQTTQUEUEOLDFILE) && !LittleFS.exists(MQTTQUEUEFILE);
+  }
+
+  /// @brief Topic (in PROGMEM, under conf.mqttTopic) of a value of a record
+  static PGM_P Key(uint8_t n);
+
+private:
+  uint32_t lastEpoch = 0; // time of the last record added
+  bool pending = true;    // records may be in the files (true at start : files left before a restart)
+  size_t sentPos = 0;     // bytes of MQTTQUEUEOLDFILE already sent (since the start : a restart sends them again)
+  size_t oldSize = 0;     // size of MQTTQUEUEOLDFILE at the last Peek()
+};
+
+#endif
@@ -162,8 +162,15 @@ void PrintConfigData()
   MainSendDebugPrintf("   # Send debug here : %s", (config_data.debugToMqtt) ? "Y" : "N");
   MainSendDebugPrintf("   # MQTT : mqtt://%s:***@%s:%u", config_data.mqttUser, config_data.mqttIP, config_data.mqttPort);
   MainSendDebugPrintf("   # MQTT Topic : %s", config_data.mqttTopic);
+  MainSendDebugPrintf("   # Single JSON : %s", (config_data.mqttJson) ? "Y" : "N");
+  MainSendDebugPrintf("   # Home Assistant discovery : %s", (config_data.mqttDiscovery) ? "Y" : "N");
+  MainSendDebugPrintf("   # QoS/retain live:%u/%d counter:%u/%d state:%u/%d logging:%u/%d", config_data.mqttQoS[MQTT_LIVE], config_data.mqttRetain[MQTT_LIVE], config_data.mqttQoS[MQTT_COUNTER], config_data.mqttRetain[MQTT_COUNTER], config_data.mqttQoS[MQTT_STATE], config_data.mqttRetain[MQTT_STATE], config_data.mqttQoS[MQTT_LOGGING], config_data.mqttRetain[MQTT_LOGGING]);
   MainSendDebugPrintf(" - interval : %u", config_data.interval);
-  MainSendDebugPrintf(" - Invert high/low tarif: %s", (config_data.InverseHigh_1_2_Tarif) ? "Y" : "N");
+  MainSendDebugPrintf(" - Continuous read : %s", (config_data.continuousRead) ? "Y" : "N");
+  MainSendDebugPrintf("   # Decimation MQTT/Domoticz/Telnet/Log : %u/%u/%u/%u", config_data.mqttDecimation, config_data.domoDecimation, config_data.telnetDecimation, config_data.logDecimation);
+  MainSendDebugPrintf(" - Send only changed : %s (full refresh : %u sec)", (config_data.sendOnlyChanged) ? "Y" : "N", config_data.fullRefresh);
+  MainSendDebugPrintf(" - Encrypted datagrams : %s", (config_data.p1Key[0] != '\0') ? "Y" : "N");
+  MainSendDebugPrintf(" - Invert high/low tarif: %s", (config_data.tariffOrder == TARIFF_AUTO) ? "Auto" : (config_data.tariffOrder == TARIFF_INVERSE) ? "Y" : "N");
   MainSendDebugPrintf(" - TELNET Actif : %s", (config_data.telnet) ? "Y" : "N");
   MainSendDebugPrintf("   # Send debug here : %s", (config_data.debugToTelnet) ? "Y" : "N");
   Yield_Delay(20);
@@ -202,6 +209,23 @@ char* GetClientName()
   return clientName;
 }
 
+/// @brief Configuration d'usine
+settings DefaultSettings()
+{
+  return (settings){SETTINGVERSION, 0, true, "", "", "10.0.0.3", 8084, 0, 0, "dsmr", "10.0.0.3", 1883, "", "", 60, false, false, TARIFF_AUTO, false, false, false, "", "", false, false, 0, false, 1, 1, 1, 1, false, 300, "", false, {0, 1, 1, 0}, {false, true, true, false}, false};
+}
+
+/// @brief Reprend une configuration de la version 3 : même début que settings jusqu'à domoticzDebugIdx (WiFi, Domoticz, MQTT, admin),
+/// seuls les champs ajoutés ensuite reçoivent leur valeur par défaut
+void MigrateSettings(settings &conf)
+{
+  settings migrated = DefaultSettings();
+  memcpy(static_cast<void *>(&migrated), &conf, offsetof(settings, continuousRead));
+  migrated.ConfigVersion = SETTINGVERSION;
+  migrated.tariffOrder = (conf.tariffOrder != 0) ? TARIFF_INVERSE : TARIFF_NORMAL; // était InverseHigh_1_2_Tarif
+  conf = migrated;
+}
+
 void setup()
 {
   #ifdef DEBUG_SERIAL_P1
@@ -222,6 +246,12 @@ void setup()
   EEPROM.begin(sizeof(struct settings));
   EEPROM.get(0, config_data);
 
+  if (config_data.ConfigVersion == SETTINGVERSIONV3)
+  {
+    MainSendDebugPrintf("[Core] Migrate settings (from:%d to:%d)", SETTINGVERSIONV3, SETTINGVERSION);
+    MigrateSettings(config_data);
+  }
+
   // Si la version de la configuration n'est celle attendu, on reset !
   if (config_data.ConfigVersion != SETTINGVERSION || config_data.BootFailed >= MAXBOOTFAILURE)
   {    
@@ -237,7 +267,7 @@ void setup()
     //Show to user is reseted !
     blink(20, 50UL);
 
-    config_data = (settings){SETTINGVERSION, 0, true, "", "", "10.0.0.3", 8084, 0, 0, "dsmr", "10.0.0.3", 1883, "", "", 60, false, false, false, false, false, false, "", "", false, false, 0};
+    config_data = DefaultSettings();
   }
   else
   {
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "P1Decryptor.h"
+
+#define FRAME_START 0xDB         // general-glo-ciphering
+#define FRAME_TITLELENGTH 8      // system title : manufacturer and serial of the meter
+#define FRAME_LONGLENGTH 0x82    // the length follows on two bytes
+#define FRAME_SECURITY 0x30      // security control : authenticated and encrypted
+#define FRAME_COUNTEROFFSET 14   // frame counter, second part of the IV
+#define FRAME_SECURED (1 + 4)    // security control and frame counter, counted in the length of the frame
+
+// security control followed by the authentication key, the same for all the Smarty meters (in RAM : read by BearSSL)
+static const uint8_t SmartyAAD[] = {FRAME_SECURITY, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  c |= 0x20; // lower case
+  return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+bool P1Decryptor::ParseKey(const char *hexKey, uint8_t *key)
+{
+  for (size_t n = 0; n < P1KEYSIZE; n++)
+  {
+    int high = hexValue(hexKey[n * 2]);
+    int low = (high < 0) ? -1 : hexValue(hexKey[n * 2 + 1]);
+    if (low < 0)
+    {
+      return false;
+    }
+    key[n] = (high << 4) | low;
+  }
+  return hexKey[P1KEYSIZE * 2] == '\0';
+}
+
+bool P1Decryptor::Begin(const char *hexKey)
+{
+  enabled = false;
+  Reset();
+  if (hexKey[0] == '\0')
+  {
+    return true;
+  }
+
+  uint8_t key[P1KEYSIZE];
+  if (!ParseKey(hexKey, key))
+  {
+    return false;
+  }
+  br_aes_small_ctr_init(&aesKeys, key, sizeof(key));
+  br_gcm_init(&gcm, &aesKeys.vtable, br_ghash_ctmul32);
+  enabled = true;
+  return true;
+}
+
+size_t P1Decryptor::Wanted() const
+{
+  switch (part)
+  {
+  case Part::Header:
+    return P1FRAMEHEADER - partPos;
+  case Part::Data:
+    return dataLeft;
+  case Part::Tag:
+    return P1FRAMETAG - partPos;
+  }
+  return 0;
+}
+
+/// @brief Check the header and start the decryption : IV = system title + frame counter
+/// @return false if the frame is not an encrypted datagram
+bool P1Decryptor::startFrame()
+{
+  size_t length = (header[11] << 8) | header[12];
+  if (header[1] != FRAME_TITLELENGTH || header[10] != FRAME_LONGLENGTH || header[13] != FRAME_SECURITY || length <= FRAME_SECURED + P1FRAMETAG)
+  {
+    return false;
+  }
+  dataLeft = length - FRAME_SECURED - P1FRAMETAG;
+
+  uint8_t iv[FRAME_TITLELENGTH + 4];
+  memcpy(iv, &header[2], FRAME_TITLELENGTH);
+  memcpy(&iv[FRAME_TITLELENGTH], &header[FRAME_COUNTEROFFSET], 4);
+  br_gcm_reset(&gcm, iv, sizeof(iv));
+  br_gcm_aad_inject(&gcm, SmartyAAD, sizeof(SmartyAAD));
+  br_gcm_flip(&gcm);
+  return true;
+}
+
+int P1Decryptor::Decrypt(uint8_t *data, size_t len)
+{
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  switch (part)
+  {
+  case Part::Header:
+    for (size_t n = 0; n < len; n++)
+    {
+      if (partPos == 0 && data[n] != FRAME_START)
+      {
+        continue; // between two frames : search the start of the next one
+      }
+      header[partPos++] = data[n];
+    }
+    if (partPos == P1FRAMEHEADER)
+    {
+      partPos = 0;
+      if (!startFrame())
+      {
+        return P1FRAMEERROR;
+      }
+      part = Part::Data;
+    }
+    return 0;
+
+  case Part::Data:
+    br_gcm_run(&gcm, 0, data, len); // in place, BearSSL keeps the partial block for the next bytes
+    dataLeft -= len;
+    if (dataLeft > 0)
+    {
+      return len;
+    }
+    lastByte = data[len - 1];
+    part = Part::Tag;
+    return len - 1;
+
+  case Part::Tag:
+    memcpy(&header[partPos], data, len);
+    partPos += len;
+    if (partPos < P1FRAMETAG)
+    {
+      return 0;
+    }
+    Reset();
+    if (!br_gcm_check_tag_trunc(&gcm, header, P1FRAMETAG))
+    {
+      return P1TAGERROR;
+    }
+    data[0] = lastByte;
+    return 1;
+  }
+  return 0;
+}
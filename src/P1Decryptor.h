@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef P1DECRYPTOR_H
+#define P1DECRYPTOR_H
+
+#include <Arduino.h>
+#include <bearssl/bearssl.h>
+
+#define P1FRAMEHEADER 18 // 0xDB, length of the system title (8), system title, 0x82, length (2), security control (0x30), frame counter (4)
+#define P1FRAMETAG 12    // GCM tag, truncated to 12 bytes
+#define P1KEYSIZE 16     // AES-128
+#define P1FRAMEERROR -1  // Decrypt() : header not valid, the frame is not an encrypted datagram (framing)
+#define P1TAGERROR -2    // Decrypt() : tag not valid, wrong key or frame corrupted
+
+/// @brief Decryption of the encrypted frames (Luxembourg Smarty : AES-128-GCM, key of the meter given by the grid operator),
+/// in front of the line assembler of P1Reader. The frame is decrypted in place as its bytes are read from the UART :
+/// the plaintext goes to the parser without a copy of the whole frame. Its last byte (the end of the CRC line) is only
+/// given once the tag is checked, so a datagram is never completed from a frame that is not authentic.
+class P1Decryptor
+{
+public:
+  /// @brief Key of the meter
+  /// @param hexKey 32 hexadecimal chars, "" = the meter sends the datagrams in clear
+  /// @return false if the key is not valid (decryption disabled)
+  bool Begin(const char *hexKey);
+
+  /// @brief Read a key written as 32 hexadecimal chars
+  /// @return false if the text is not a key
+  static bool ParseKey(const char *hexKey, uint8_t *key);
+
+  bool Enabled() const
+  {
+    return enabled;
+  }
+
+  /// @brief Bytes to read now : a read never goes past the part of the frame in progress (header, data, tag)
+  size_t Wanted() const;
+
+  /// @brief Decrypt the next bytes of the frame
+  /// @param data bytes read from the UART (up to Wanted()), the plaintext is written from the start
+  /// @param len count of bytes
+  /// @return count of plaintext bytes, P1FRAMEERROR or P1TAGERROR if the frame is rejected
+  int Decrypt(uint8_t *data, size_t len);
+
+  /// @brief Forget the frame in progress, wait the start of the next one
+  void Reset()
+  {
+    part = Part::Header;
+    partPos = 0;
+  }
+
+private:
+  enum class Part : uint8_t
+  {
+    Header,
+    Data,
+    Tag
+  };
+
+  bool enabled = false;
+  Part part = Part::Header;
+  size_t partPos = 0;                 // bytes of the header or of the tag received
+  size_t dataLeft = 0;                // encrypted bytes of the frame not received yet
+  uint8_t header[P1FRAMEHEADER];      // then the tag
+  uint8_t lastByte = 0;               // last byte of the plaintext, held until the tag is checked
+  br_aes_small_ctr_keys aesKeys = {}; // small implementation : no table in RAM, fast enough for one frame per second
+  br_gcm_context gcm = {};
+
+  bool startFrame();
+};
+
+#endif
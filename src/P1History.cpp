@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "P1History.h"
+
+#define RECORD_HEADER 3 // uint16 length of the lines, uint8 keyframe
+
+/// @brief Write a length on 7 bits per byte (1 byte up to 127)
+/// @return bytes written, 0 if there is not enough room
+static size_t putVarint(uint8_t *dest, size_t room, size_t value)
+{
+  size_t n = 0;
+  do
+  {
+    if (n >= room)
+    {
+      return 0;
+    }
+    dest[n++] = (value & 0x7F) | ((value > 0x7F) ? 0x80 : 0);
+    value >>= 7;
+  } while (value != 0);
+  return n;
+}
+
+/// @brief Write several lengths one after the other
+/// @return bytes written, 0 if there is not enough room
+static size_t putVarints(uint8_t *dest, size_t room, std::initializer_list<size_t> values)
+{
+  size_t pos = 0;
+  for (size_t value : values)
+  {
+    size_t n = putVarint(dest + pos, room - pos, value);
+    if (n == 0)
+    {
+      return 0;
+    }
+    pos += n;
+  }
+  return pos;
+}
+
+/// @brief Read a length written by putVarint()
+/// @return bytes read
+static size_t getVarint(const uint8_t *src, size_t &value)
+{
+  size_t n = 0;
+  value = 0;
+  do
+  {
+    value |= static_cast<size_t>(src[n] & 0x7F) << (7 * n);
+  } while (src[n++] & 0x80);
+  return n;
+}
+
+static size_t recordLength(const uint8_t *record)
+{
+  return record[0] | (record[1] << 8);
+}
+
+/// @brief Read the part of an entry that follows the count of identical lines
+/// @param pos position in the record, moved after the line
+/// @param same out: chars identical to the line of the keyframe
+/// @param literal out: chars that differ
+/// @param literalLen out: count of these chars
+static void readLine(const uint8_t *&pos, size_t &same, const char *&literal, size_t &literalLen)
+{
+  pos += getVarint(pos, same);
+  pos += getVarint(pos, literalLen);
+  literal = reinterpret_cast<const char *>(pos);
+  pos += literalLen;
+}
+
+/// @brief Read the next line of a keyframe (its entries never have identical lines or chars)
+static void readKeyLine(const uint8_t *&pos, const char *&text, size_t &len)
+{
+  size_t unused;
+  pos += getVarint(pos, unused);
+  readLine(pos, unused, text, len);
+}
+
+/// @brief Make room for size more bytes of the datagram in progress, by dropping the oldest groups.
+/// The group of the last datagram is never dropped : the datagram in progress is not valid yet.
+/// @return false if it cannot fit beside the last datagram
+bool P1History::reserve(size_t size)
+{
+  while (used + pending + size > sizeof(buffer))
+  {
+    if (used == 0 || keyOffset == 0)
+    {
+      return false; // no group left, or the oldest one is the last group
+    }
+    dropOldestGroup();
+  }
+  return true;
+}
+
+/// @brief Add bytes at the end of the record in progress
+bool P1History::write(const uint8_t *data, size_t size)
+{
+  if (overflow || !reserve(size))
+  {
+    overflow = true;
+    return false;
+  }
+  memcpy(buffer + used + pending, data, size);
+  pending += size;
+  return true;
+}
+
+/// @brief Drop the oldest keyframe with its deltas (the record in progress is moved with the others)
+void P1History::dropOldestGroup()
+{
+  size_t next = 0;
+  uint16_t dropped = 0;
+  do
+  {
+    next += RECORD_HEADER + recordLength(buffer + next);
+    dropped++;
+  } while (next < used && buffer[next + 2] == 0);
+
+  memmove(buffer, buffer + next, used + pending - next);
+  used -= next;
+  count -= dropped;
+  if (used == 0)
+  {
+    keyOffset = 0;
+    lastOffset = 0;
+    groupCount = 0;
+  }
+  else
+  {
+    keyOffset -= next;
+    lastOffset -= next;
+  }
+}
+
+/// @brief A keyframe is stored in full, the datagrams of its group as a delta. A new group starts after P1HISTORYGROUP
+/// datagrams, or when the group would take more than half of the ring : the last datagram and the one received after
+/// it fit together, unless the new one is much longer (see Commit()).
+void P1History::Begin()
+{
+  // the next record is estimated as large as the keyframe
+  pendingKey = (groupCount == 0 || groupCount >= P1HISTORYGROUP ||
+                used - keyOffset + RECORD_HEADER + recordLength(buffer + keyOffset) > sizeof(buffer) / 2);
+  recording = true;
+  overflow = false;
+  pending = 0;
+  pendingSize = 0;
+  keyPos = RECORD_HEADER;
+  identical = 0;
+  uint8_t header[RECORD_HEADER] = {}; // written by Commit()
+  write(header, sizeof(header));
+}
+
+/// @brief Each entry of the record is : count of lines identical to the keyframe, then the next line as
+/// the count of its first chars identical to the same line of the keyframe and the chars that differ.
+void P1History::Append(const char *text, size_t len)
+{
+  if (!recording || overflow)
+  {
+    return;
+  }
+  pendingSize += len;
+
+  size_t same = 0;
+  if (!pendingKey && keyPos < RECORD_HEADER + recordLength(buffer + keyOffset))
+  {
+    const uint8_t *key = buffer + keyOffset + keyPos;
+    const uint8_t *keyStart = key;
+    const char *keyLine;
+    size_t keyLen;
+    readKeyLine(key, keyLine, keyLen);
+    keyPos += key - keyStart;
+    while (same < len && same < keyLen && keyLine[same] == text[same])
+    {
+      same++;
+    }
+    if (same == len && same == keyLen)
+    {
+      identical++;
+      return;
+    }
+  }
+
+  uint8_t entry[3 * 5]; // 3 varints of 32 bits
+  size_t n = putVarints(entry, sizeof(entry), {identical, same, len - same});
+  if (write(entry, n))
+  {
+    write(reinterpret_cast<const uint8_t *>(text + same), len - same);
+  }
+  identical = 0;
+}
+
+bool P1History::Commit()
+{
+  if (!recording)
+  {
+    return false;
+  }
+  recording = false;
+  if (identical > 0)
+  {
+    uint8_t entry[5];
+    write(entry, putVarints(entry, sizeof(entry), {identical}));
+  }
+  if (overflow)
+  {
+    // valid but not kept : the last datagram is not the last one anymore, the ring is emptied for the next one
+    pending = 0;
+    used = 0;
+    keyOffset = 0;
+    lastOffset = 0;
+    groupCount = 0;
+    count = 0;
+    return false;
+  }
+
+  uint8_t *record = buffer + used;
+  size_t lines = pending - RECORD_HEADER;
+  record[0] = lines & 0xFF;
+  record[1] = lines >> 8;
+  record[2] = pendingKey ? 1 : 0;
+  if (pendingKey)
+  {
+    keyOffset = used;
+    groupCount = 0;
+  }
+  lastOffset = used;
+  lastSize = pendingSize;
+  used += pending;
+  pending = 0;
+  groupCount++;
+  count++;
+  return true;
+}
+
+/// @brief Write the text of a record
+/// @param key keyframe of its group (the record itself for a keyframe)
+void P1History::replayRecord(const uint8_t *record, const uint8_t *key, const std::function<void(const char *text, size_t len)> &write)
+{
+  const uint8_t *line = record + RECORD_HEADER;
+  const uint8_t *end = line + recordLength(record);
+  const uint8_t *keyLine = key + RECORD_HEADER;
+  const uint8_t *keyEnd = keyLine + recordLength(key);
+  const char *keyText = nullptr;
+  size_t keyLen = 0;
+  while (line < end)
+  {
+    size_t identical;
+    line += getVarint(line, identical);
+    for (; identical > 0 && keyLine < keyEnd; identical--)
+    {
+      readKeyLine(keyLine, keyText, keyLen);
+      write(keyText, keyLen);
+    }
+    if (line >= end)
+    {
+      break;
+    }
+
+    size_t same, literalLen;
+    const char *literal;
+    readLine(line, same, literal, literalLen);
+    if (keyLine < keyEnd)
+    {
+      readKeyLine(keyLine, keyText, keyLen); // the lines of the keyframe stay aligned
+    }
+    if (same > 0)
+    {
+      write(keyText, same);
+    }
+    if (literalLen > 0)
+    {
+      write(literal, literalLen);
+    }
+  }
+}
+
+void P1History::Replay(const std::function<void(const char *text, size_t len)> &write) const
+{
+  const uint8_t *key = buffer;
+  size_t pos = 0;
+
+  while (pos < used)
+  {
+    const uint8_t *record = buffer + pos;
+    if (record[2] != 0)
+    {
+      key = record;
+    }
+    replayRecord(record, key, write);
+    pos += RECORD_HEADER + recordLength(record);
+  }
+}
+
+size_t P1History::ReplaySize() const
+{
+  size_t size = 0;
+  Replay([&size](const char *, size_t len)
+         { size += len; });
+  return size;
+}
+
+void P1History::ReplayLast(const std::function<void(const char *text, size_t len)> &write) const
+{
+  if (count > 0)
+  {
+    replayRecord(buffer + lastOffset, buffer + keyOffset, write); // the last datagram is in the last group
+  }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef P1HISTORY_H
+#define P1HISTORY_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define P1HISTORYSIZE 4608 // bytes of the ring of the last raw datagrams : two of the longest (Siconia ~1.1 KB with a text message of 1 KB, ~2.3 KB encoded)
+#define P1HISTORYGROUP 16  // a datagram stored in full (keyframe), then up to N-1 stored as a delta to it
+
+/// @brief Last raw datagrams, kept to replay an incident (/rawhistory, telnet "history", bench/P1Bench).
+/// Two datagrams differ only by a few values : each line is stored as the count of chars identical
+/// to the same line of the keyframe of its group, followed by the chars that differ.
+/// When the ring is full, the oldest group is dropped.
+/// The datagram in progress is encoded after the last one as it is received : the last one stays
+/// readable (ReplayLast) until the new one is valid, it is the only copy of the raw datagram (/raw, telnet).
+class P1History
+{
+public:
+  /// @brief Start a new datagram, the one in progress (not committed) is discarded
+  void Begin();
+
+  /// @brief Add a part of the datagram in progress
+  /// @param text a line, or a part of a long line : the same cut from one datagram to the next one gives a smaller delta
+  /// @param len length of the text
+  void Append(const char *text, size_t len);
+
+  /// @brief The datagram in progress is complete and valid : it becomes the last one
+  /// @return false if it didn't fit beside the last one : the history is emptied
+  bool Commit();
+
+  /// @brief Drop the datagram in progress (bad CRC, timeout)
+  void Abort()
+  {
+    recording = false;
+    pending = 0;
+  }
+
+  /// @brief Write the datagrams kept, oldest first, as they were received
+  /// @param write called for each part of text (a line or a part of line)
+  void Replay(const std::function<void(const char *text, size_t len)> &write) const;
+
+  /// @brief Length of the text written by Replay()
+  size_t ReplaySize() const;
+
+  /// @brief Write the last datagram, as it was received (nothing if none)
+  void ReplayLast(const std::function<void(const char *text, size_t len)> &write) const;
+
+  /// @brief Length of the text written by ReplayLast(), counted when it was received
+  size_t LastSize() const
+  {
+    return (count > 0) ? lastSize : 0;
+  }
+
+  uint16_t Count() const
+  {
+    return count;
+  }
+
+  size_t Used() const
+  {
+    return used;
+  }
+
+private:
+  uint8_t buffer[P1HISTORYSIZE]; // records : uint16 length of the lines, uint8 keyframe, then the lines
+  size_t used = 0;               // bytes of buffer in use
+  size_t keyOffset = 0;          // record of the keyframe of the last group
+  size_t lastOffset = 0;         // record of the last datagram
+  size_t lastSize = 0;           // chars of the last datagram
+  uint8_t groupCount = 0;        // datagrams of the last group, 0 = no keyframe
+  uint16_t count = 0;            // datagrams kept
+
+  // datagram in progress, encoded at buffer + used
+  bool recording = false;
+  bool overflow = false;         // it doesn't fit in the ring
+  bool pendingKey = false;       // it is a keyframe
+  size_t pending = 0;            // bytes of its record
+  size_t pendingSize = 0;        // chars of its text
+  size_t keyPos = 0;             // next line of the keyframe to compare, from keyOffset
+  size_t identical = 0;          // lines identical to the keyframe not written yet
+
+  bool reserve(size_t size);
+  bool write(const uint8_t *data, size_t size);
+  void dropOldestGroup();
+  static void replayRecord(const uint8_t *record, const uint8_t *key, const std::function<void(const char *text, size_t len)> &write);
+};
+
+#endif
@@ -24,11 +24,135 @@
 
 #include "P1Reader.h"
 
+#define OBIS_FIELD(field, type, size, a, b, c, d, e, alt, ...) {OBISKey(a, b, c, d, e), P1Reader::OBISType::type, sizeof(P1Reader::DataP1::field), offsetof(P1Reader::DataP1, field), offsetof(P1Reader::DataP1, alt), P1Reader::Field::field, P1Reader::Field::alt},
+#define OBIS_IGNORE(a, b, c, d, e) {OBISKey(a, b, c, d, e), P1Reader::OBISType::Ignore, 0, 0, 0, 0, 0},
+// other references of the M-Bus values (DSMR 5 Belgium : 0-n:96.1.1 and 0-n:24.2.3, DSMR 2.2/3 : 0-n:24.3.0)
+#define OBIS_MBUS_ALIAS(n)                                                                                                                                                                                                     \
+  {OBISKey(0, n, 96, 1, 1), P1Reader::OBISType::Text, sizeof(P1Reader::DataP1::mbus##n##Id), offsetof(P1Reader::DataP1, mbus##n##Id), offsetof(P1Reader::DataP1, mbus##n##Id), P1Reader::Field::mbus##n##Id, P1Reader::Field::mbus##n##Id}, \
+  {OBISKey(0, n, 24, 2, 3), P1Reader::OBISType::Timed, sizeof(P1Reader::DataP1::mbus##n##Value), offsetof(P1Reader::DataP1, mbus##n##Value), offsetof(P1Reader::DataP1, mbus##n##Time), P1Reader::Field::mbus##n##Value, P1Reader::Field::mbus##n##Time}, \
+  {OBISKey(0, n, 24, 3, 0), P1Reader::OBISType::TimedNextLine, sizeof(P1Reader::DataP1::mbus##n##Value), offsetof(P1Reader::DataP1, mbus##n##Value), offsetof(P1Reader::DataP1, mbus##n##Time), P1Reader::Field::mbus##n##Value, P1Reader::Field::mbus##n##Time}, \
+  OBIS_IGNORE(0, n, 24, 4, 0) // valve position
+
+/// @brief Lines of the datagram : the values of P1_FIELDS and the known references that are not used
+static constexpr P1Reader::OBISEntry OBISRows[] = {
+  P1_METER_FIELDS(OBIS_FIELD)
+  OBIS_MBUS_ALIAS(1)
+  OBIS_MBUS_ALIAS(2)
+  OBIS_MBUS_ALIAS(3)
+  OBIS_MBUS_ALIAS(4)
+  {OBISKey(1, 3, 0, 2, 8), P1Reader::OBISType::Text, sizeof(P1Reader::DataP1::P1version), offsetof(P1Reader::DataP1, P1version), offsetof(P1Reader::DataP1, P1version), P1Reader::Field::P1version, P1Reader::Field::P1version}, // DSMR version (Netherlands)
+  OBIS_IGNORE(0, 0, 17, 0, 0)   // 0-0:17.0.0 limiter threshold
+  OBIS_IGNORE(0, 0, 96, 3, 10)  // 0-0:96.3.10 breaker state
+  OBIS_IGNORE(0, 0, 96, 13, 1)  // 0-0:96.13.1 numeric message (DSMR 2.2/3)
+  OBIS_IGNORE(1, 0, 31, 4, 0)   // 1-0:31.4.0 current limit
+};
+
+/// @brief Rows of the OBIS table : the Capture fields have no line of their own
+static constexpr size_t OBISRowsParsed()
+{
+  size_t count = 0;
+  for (const P1Reader::OBISEntry &row : OBISRows)
+  {
+    if (row.type != P1Reader::OBISType::Capture)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+static constexpr size_t OBISTableSize = OBISRowsParsed();
+
+/// @brief OBISRows sorted by key at compilation, for the binary search of findOBISEntry()
+struct OBISSortedTable
+{
+  P1Reader::OBISEntry rows[OBISTableSize];
+  constexpr OBISSortedTable() : rows()
+  {
+    size_t count = 0;
+    for (const P1Reader::OBISEntry &row : OBISRows)
+    {
+      if (row.type == P1Reader::OBISType::Capture)
+      {
+        continue;
+      }
+      size_t j = count++;
+      while (j > 0 && rows[j - 1].key > row.key)
+      {
+        rows[j] = rows[j - 1];
+        j--;
+      }
+      rows[j] = row;
+    }
+  }
+};
+static constexpr OBISSortedTable OBISTable PROGMEM;
+
+static constexpr bool OBISTableIsSorted()
+{
+  for (size_t i = 1; i < OBISTableSize; i++)
+  {
+    if (OBISTable.rows[i - 1].key >= OBISTable.rows[i].key)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(OBISTableIsSorted(), "an OBIS reference is defined twice");
+
+// the peaks start at the same place in every PeakList
+static constexpr size_t PeakListOffset = offsetof(P1Reader::PeakList<1>, peak);
+static_assert(offsetof(P1Reader::PeakList<13>, peak) == PeakListOffset, "the peaks must be after the count in PeakList");
+
+// texts of the fields, in flash
+#define FIELD_STRINGS(field, type, size, a, b, c, d, e, alt, mqtt, jsonGroup, json, unit, domoticz) \
+  static const char FieldName_##field[] PROGMEM = #field;                                                   \
+  static const char FieldMQTT_##field[] PROGMEM = mqtt;                                                     \
+  static const char FieldJSONGroup_##field[] PROGMEM = jsonGroup;                                           \
+  static const char FieldJSON_##field[] PROGMEM = json;                                                     \
+  static const char FieldUnit_##field[] PROGMEM = unit;
+P1_FIELDS(FIELD_STRINGS)
+
+#define FIELD_INFO(field, type, size, a, b, c, d, e, alt, mqtt, jsonGroup, json, unit, domoticz) \
+  {FieldName_##field, FieldMQTT_##field, FieldJSONGroup_##field, FieldJSON_##field, FieldUnit_##field, OBISKey(a, b, c, d, e), P1Reader::OBISType::type, domoticz, offsetof(P1Reader::DataP1, field)},
+
+/// @brief Description of the fields, indexed by P1Reader::Field
+static const P1Reader::FieldInfo FieldTable[P1Reader::Field::Count] PROGMEM = {
+  P1_FIELDS(FIELD_INFO)
+};
+
+/// @brief Table of the CRC16 used by DSMR (CRC-16/ARC : polynomial 0x8005 reflected, initial value 0)
+struct CRC16Table
+{
+  uint16_t value[256];
+  constexpr CRC16Table() : value()
+  {
+    for (uint16_t i = 0; i < 256; i++)
+    {
+      uint16_t crc = i;
+      for (uint8_t bit = 0; bit < 8; bit++)
+      {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+      }
+      value[i] = crc;
+    }
+  }
+};
+static constexpr CRC16Table CRC16 PROGMEM;
+
+static inline uint16_t CRC16Update(uint16_t crc, uint8_t c)
+{
+  return (crc >> 8) ^ pgm_read_word(&CRC16.value[(crc ^ c) & 0xFF]);
+}
+
 P1Reader::P1Reader(settings &currentConf) : conf(currentConf)
 {
-  //Serial.setRxBufferSize(MAXLINELENGTH-2);
+  Serial.setRxBufferSize(P1RXBUFFERSIZE); // must be done before begin()
   Serial.begin(SERIALSPEED);
-  datagram.reserve(1500);
+  if (!decryptor.Begin(conf.p1Key))
+  {
+    MainSendDebug("[P1] Decryption key not valid (32 hexadecimal chars), datagrams read in clear");
+  }
 }
 
 void P1Reader::RTS_on() // switch on Data Request
@@ -40,6 +164,10 @@ void P1Reader::RTS_on() // switch on Data Request
     Serial.read(); //flush input buffer
     delay(2);
   }
+  lineLength = 0;
+  lineContinued = false;
+  crcRunning = false;
+  decryptor.Reset();
   
   state = State::WAITING; // signal that we are waiting for a valid start char (aka /)
   digitalWrite(DR, HIGH); // turn on Data Request
@@ -73,33 +201,81 @@ int P1Reader::FindCharInArray(const char array[], char c, int len)
   return -1;
 }
 
-String P1Reader::identifyMeter(String Name)
+/// @brief Known meters : X(id, start of the header after the '/', name, MeterFlag).
+/// A prefix must come before the shorter ones it starts with (checked below).
+#define METER_PROFILES(X) \
+  X(Fluvius,      "FLU5\\",            "Siconia",                 P1Reader::MeterInverseTariff) \
+  X(IskraAM550,   "ISK5\\2M550E-1011", "ISKRA AM550e-1011",       0) \
+  X(IskraME382,   "ISk5\\2ME382",      "ISKRA ME382",             P1Reader::MeterGasNextLine) \
+  X(Kaifa,        "KFM5KAIFA-METER",   "Kaifa  (MA105 of MA304)", 0) \
+  X(Kamstrup,     "KMP5",              "Kamstrup",                P1Reader::MeterGasNextLine) \
+  X(LandisE350,   "XMX5LGBBFG10",      "Landis + Gyr E350",       0) \
+  X(Landis,       "XMX5LG",            "Landis + Gyr",            0) \
+  X(SagemcomT210, "Ene5\\T210-D",      "Sagemcom T210-D",         0)
+
+#define METER_STRINGS(id, prefix, name, flags)               \
+  static constexpr char MeterPrefix_##id[] PROGMEM = prefix; \
+  static const char MeterName_##id[] PROGMEM = name;
+METER_PROFILES(METER_STRINGS)
+
+#define METER_PROFILE(id, prefix, name, flags) {MeterPrefix_##id, MeterName_##id, flags},
+static constexpr P1Reader::MeterProfile MeterProfiles[] PROGMEM = {METER_PROFILES(METER_PROFILE)};
+
+// any meter not in the list : every format accepted, tariffs as sent
+static const char MeterNameUnknown[] PROGMEM = "UNKNOW";
+static constexpr uint8_t MeterFlagsUnknown = P1Reader::MeterGasNextLine;
+
+static constexpr bool startsWith(const char *text, const char *prefix)
 {
-  if (Name.indexOf("FLU5\\") != -1)
-  {
-    return "Siconia"; //Belgium
-  }
-  if (Name.indexOf("ISK5\\2M550E-1011") != -1)
+  for (; *prefix != '\0'; text++, prefix++)
   {
-    return "ISKRA AM550e-1011";
-  }
-  if (Name.indexOf("KFM5KAIFA-METER") != -1)
-  {
-    return "Kaifa  (MA105 of MA304)";
-  }
-  if (Name.indexOf("XMX5LGBBFG10") != -1)
-  {
-    return "Landis + Gyr E350";
+    if (*text != *prefix)
+    {
+      return false;
+    }
   }
-  if (Name.indexOf("XMX5LG") != -1)
+  return true;
+}
+
+/// @brief The first prefix that matches is used : no prefix may hide a longer one placed after it
+static constexpr bool MeterProfilesReachable()
+{
+  for (size_t i = 0; i < sizeof(MeterProfiles) / sizeof(MeterProfiles[0]); i++)
   {
-    return "Landis + Gyr";
+    for (size_t j = i + 1; j < sizeof(MeterProfiles) / sizeof(MeterProfiles[0]); j++)
+    {
+      if (startsWith(MeterProfiles[j].prefix, MeterProfiles[i].prefix))
+      {
+        return false;
+      }
+    }
   }
-  if (Name.indexOf("Ene5\\T210-D") != -1)
+  return true;
+}
+static_assert(MeterProfilesReachable(), "a meter prefix must be placed before the shorter ones");
+
+/// @brief Select the profile of the meter from the header line (ex: /FLU5\253769484_A)
+/// @param header position of the '/'
+/// @param len chars of the line from the '/'
+void P1Reader::identifyMeter(const char *header, int len)
+{
+  MeterProfile profile = {nullptr, MeterNameUnknown, MeterFlagsUnknown};
+  for (const MeterProfile &row : MeterProfiles)
   {
-    return "Sagemcom T210-D";
+    MeterProfile candidate;
+    memcpy_P(&candidate, &row, sizeof(MeterProfile));
+    size_t prefixLen = strlen_P(candidate.prefix);
+    if (static_cast<int>(prefixLen) < len && strncmp_P(header + 1, candidate.prefix, prefixLen) == 0)
+    {
+      profile = candidate;
+      break;
+    }
   }
-  return "UNKNOW";
+
+  meterName = FPSTR(profile.name);
+  meterFlags = profile.flags;
+  inverseTariff = (conf.tariffOrder == TARIFF_AUTO) ? (meterFlags & MeterInverseTariff) != 0 : (conf.tariffOrder == TARIFF_INVERSE);
+  MainSendDebugPrintf("[P1] Meter : %s (tariffs %s)", meterName.c_str(), inverseTariff ? "swapped" : "as sent");
 }
 
 void P1Reader::decodeTelegram(int len)
@@ -112,22 +288,7 @@ void P1Reader::decodeTelegram(int len)
     if (startChar >= 0)
     { // start found. Reset CRC calculation
       MainSendDebug("[P1] Start of datagram found");
-      
-      // reset datagram
-      datagram = "";
-      dataEnd = false;
-      state = State::READING;
-
-      for (int cnt = startChar; cnt < len - startChar; cnt++)
-      {
-        datagram += telegram[cnt];
-      }
-
-      if (meterName == "")
-      {
-        meterName = identifyMeter(telegram);
-      }
-
+      startDatagram(startChar, len);
       return;
     }
     else
@@ -138,290 +299,878 @@ void P1Reader::decodeTelegram(int len)
 
   if (state == State::READING)
   {
+    if (startChar >= 0)
+    {
+      // the end of the previous one was lost : its values are not covered by a CRC, it is dropped
+      crcErrors++;
+      MainSendDebug("[P1] Start of datagram before the end of the previous one, datagram rejected");
+      history.Abort();
+      startDatagram(startChar, len);
+      return;
+    }
+
     if (endChar >= 0)
     { // we have found the endchar !
       MainSendDebug("[P1] End found");
       dataEnd = true; // we're at the end of the data stream, so mark (for raw data output) We don't know if the data is valid, we will test this below.
-     
-      if (datagram.length() < 2048)
+
+      if (!CheckCRC(endChar, len))
       {
-        for (int cnt = 0; cnt < len; cnt++)
-        {
-          datagram += telegram[cnt];
-        }
-        datagram += "\r\n";
+        // datagram dropped, wait the next one
+        history.Abort();
+        dataEnd = false;
+        state = State::WAITING;
+        return;
       }
-      else
+     
+      appendRaw(telegram, len);
+      appendRaw("\r\n", 2);
+      if (!history.Commit())
       {
-        MainSendDebug("[P1] Buffer overflow ?");
-        state = State::FAULT;
-        return;
+        // values decoded anyway, only the raw output is lost
+        MainSendDebugPrintf("[P1] Datagram longer than %d, raw output not available", P1HISTORYSIZE);
       }
 
+      UpdateCapacity(BackBuffer());
+
+      // publish the new snapshot : consumers never see a datagram partially parsed
+      BackBuffer().sequence = GetSnapshot().sequence + 1;
+      BackBuffer().captureTime = millis();
+      frontBuffer ^= 1;
+
       state = State::DONE;
-      LastSample = millis();
       return;
     }
     else
     { // no endchar, so normal line, process
-      for (int cnt = 0; cnt < len; cnt++)
-      {
-        datagram += telegram[cnt];
-      }
-      OBISparser(len);
+      appendRaw(telegram, len);
+      OBISparser(len, true);
     }
     return;
   }
   return;
 }
 
-String P1Reader::readFirstParenthesisVal(int start, int end)
+/// @brief Start a new datagram on its header line : the values decoded since the previous one are dropped
+/// @param startChar position of the '/'
+/// @param len length of the line
+void P1Reader::startDatagram(int startChar, int len)
+{
+  history.Begin(); // the last datagram stays readable until this one is valid
+  dataEnd = false;
+  state = State::READING;
+  BackBuffer() = GetSnapshot(); // keep the values of the lines missing in this datagram
+  BackBuffer().changed = (GetSnapshot().sequence == 0) ? ~0ULL : 0;
+  lineGroup = 0;
+  valueOnNextLine = false;
+  lineContinued = false;
+  meterAverage = false;
+
+  appendRaw(telegram + startChar, len - startChar);
+
+  if (meterName == "")
+  {
+    identifyMeter(telegram + startChar, len - startChar);
+  }
+}
+
+/// @brief Add the chars received to the raw datagram in progress (in the history)
+void P1Reader::appendRaw(const char *text, size_t len)
+{
+  history.Append(text, len);
+}
+
+/// @brief The line buffer is full before the end of the line : decode what is complete,
+/// keep the rest at the start of telegram[] for the next bytes
+void P1Reader::decodeLinePart()
+{
+  if (state != State::READING)
+  {
+    // waiting the '/' : a line this long is not the header
+    lineLength = 0;
+    return;
+  }
+
+  int consumed = OBISparser(lineLength, false);
+  appendRaw(telegram, consumed);
+  lineLength -= consumed;
+  memmove(telegram, telegram + consumed, lineLength);
+}
+
+/// @brief Compare the CRC computed during the reception with the one given after the '!'
+/// @param endChar position of the '!'
+/// @param len length of the line
+/// @return true if valid, or if the meter doesn't send a CRC (DSMR 2.2 and 3)
+bool P1Reader::CheckCRC(int endChar, int len)
 {
-  String value = "";
+  uint16_t received = 0;
+  int digits = 0;
+
+  for (int i = endChar + 1; i < len && digits < 4 && isxdigit(telegram[i]); i++, digits++)
+  {
+    char c = telegram[i];
+    received = (received << 4) | ((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+  }
+
+  if (digits == 0)
+  {
+    return true;
+  }
+
+  if (digits != 4 || received != crc)
+  {
+    crcErrors++;
+    MainSendDebugPrintf("[P1] CRC error (received:%04X computed:%04X), datagram rejected", received, crc);
+    return false;
+  }
+  return true;
+}
+
+/// @brief Copy the value of the first parenthesis (leading zeros removed) directly from the line
+/// @param start position of the '('
+/// @param end length of the line
+/// @param dest destination buffer, always null terminated
+/// @param size size of the destination buffer
+void P1Reader::copyFirstParenthesisVal(int start, int end, char *dest, size_t size)
+{
+  size_t len = 0;
   int i = start + 1;
-  bool trailingZero = true;
-  while ((telegram[i] != ')') && (i < end))
+
+  while (i < end && telegram[i] == '0')
   {
-    if (trailingZero && telegram[i] == '0')
-    {
-      i++;
-    }
-    else
+    i++;
+  }
+
+  while (i < end && telegram[i] != ')')
+  {
+    if (len + 1 < size)
     {
-      value += (char)telegram[i];
-      trailingZero = false;
-      i++;
+      dest[len++] = telegram[i];
     }
+    i++;
   }
-  return value;
+  dest[len] = '\0';
 }
 
-String P1Reader::readUntilStar(int start, int end)
+/// @brief Days since 1970-01-01 of a date of the calendar (algorithm of H. Hinnant, years from 2000)
+static uint32_t daysFromCivil(uint32_t year, uint32_t month, uint32_t day)
 {
-  String value = "";
-  int i = start + 1;
-  bool trailingZero = true;
-  while ((telegram[i] != '*') && (i < end))
+  year -= (month <= 2);
+  uint32_t era = year / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+/// @brief Local time of the meter as YYMMDDhhmm, the format of Peak::time
+/// @param local seconds since 1970 in local time (epoch + utcOffset)
+static uint32_t localToDecimal(uint32_t local)
+{
+  uint32_t dayOfEra = local / 86400 + 719468 - 146097 * 5; // era from 2000-03-01
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  uint32_t day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  uint32_t month = (mp < 10) ? mp + 3 : mp - 9;
+  uint32_t year = yearOfEra + (month <= 2);
+  uint32_t minutes = (local % 86400) / 60;
+  return ((year % 100) * 10000 + month * 100 + day) * 10000 + (minutes / 60) * 100 + minutes % 60;
+}
+
+/// @brief Convert 0-0:1.0.0 (YYMMDDhhmmssX, local time, X = S summer / W winter) in UTC.
+/// The date changes once a day : its conversion is kept, only hh:mm:ss is added on each datagram.
+/// @param start position of the '('
+/// @param end length of the line
+/// @param utcOffset out: local time - UTC in seconds
+/// @return seconds since 1970, 0 if the timestamp is not valid
+uint32_t P1Reader::parseTimestamp(int start, int end, int16_t &utcOffset)
+{
+  const char *text = telegram + start + 1;
+  if (end - start < 14)
   {
-    if (trailingZero && telegram[i] != '0')
+    return 0;
+  }
+  for (uint8_t n = 0; n < 12; n++)
+  {
+    if (!isDigit(text[n]))
     {
-      trailingZero = false;
+      return 0;
     }
-    if (telegram[i] == '0' && telegram[i + 1] == '.')
+  }
+  char dst = (text[12] == 'S') ? 'S' : 'W'; // no suffix (DSMR 4.0 and older) : standard time
+  utcOffset = P1UTCOFFSET + ((dst == 'S') ? 3600 : 0);
+
+  if (memcmp(timestampDate, text, 6) != 0 || timestampDate[6] != dst)
+  {
+    auto number = [text](uint8_t pos)
     {
-      // value += (char)telegram[i];
-      trailingZero = false;
-    }
-    if (!trailingZero)
+      return static_cast<uint32_t>((text[pos] - '0') * 10 + (text[pos + 1] - '0'));
+    };
+    uint32_t month = number(2);
+    uint32_t day = number(4);
+    if (month < 1 || month > 12 || day < 1 || day > 31)
     {
-      value += (char)telegram[i];
+      return 0;
     }
+    timestampDay = daysFromCivil(2000 + number(0), month, day) * 86400 - utcOffset;
+    memcpy(timestampDate, text, 6);
+    timestampDate[6] = dst;
+  }
+
+  uint32_t hour = (text[6] - '0') * 10 + (text[7] - '0');
+  uint32_t minute = (text[8] - '0') * 10 + (text[9] - '0');
+  uint32_t second = (text[10] - '0') * 10 + (text[11] - '0');
+  return timestampDay + hour * 3600 + minute * 60 + second;
+}
+
+/// @brief Read the integer value of the first parenthesis, ex: (00004) -> 4
+/// @param start position of the '('
+/// @param end length of the line
+/// @return the value, 0 if nothing valid was found
+uint32_t P1Reader::parseFirstParenthesisUInt(int start, int end)
+{
+  uint32_t value = 0;
+  int i = start + 1;
+
+  while (i < end && isDigit(telegram[i]))
+  {
+    value = value * 10 + (telegram[i] - '0');
     i++;
   }
   return value;
 }
 
-String P1Reader::readBetweenDoubleParenthesis(int start, int end)
+/// @brief Position of the value that follows the first parenthesis (for line like : 0-1:24.2.1(231029141500W)(05446.465*m3))
+/// @param start position of the first '('
+/// @param end length of the line
+/// @return position of the second '('
+int P1Reader::findSecondParenthesis(int start, int end)
 {
-  String value = "";
   int i = start + 1;
-  while ((telegram[i] != ')') && (telegram[i + 1] != '('))
+  while (i < end && telegram[i] != ')' && telegram[i + 1] != '(')
   {
-    i++; // we have found the intersection of the command and data
-         // 0-1:24.2.1(231029141500W)(05446.465*m3)
+    i++;
   }
-  i++;
-  value = readUntilStar(i, end);
-  return value;
+  return i + 1;
+}
+
+/// @brief Pack a time of the meter (YYMMDDhhmmssX) in a number YYMMDDhhmm
+/// @return 0 if the text is not a time
+static uint32_t packTime(const char *text, const char *end)
+{
+  uint32_t time = 0;
+  for (uint8_t n = 0; n < 10; n++, text++)
+  {
+    if (text >= end || !isDigit(*text))
+    {
+      return 0;
+    }
+    time = time * 10 + (*text - '0');
+  }
+  return time;
 }
 
-void P1Reader::OBISparser(int len)
+/// @brief Parse the history of the peaks (0-0:98.1.0) :
+/// (count)(1-0:1.6.0)(1-0:1.6.0) then, for each month, (start of the month)(time of the peak)(value*kW)
+/// @param start position of the first '('
+/// @param end length of the line
+/// @param dest PeakList of the field
+/// @param size size of the PeakList
+void P1Reader::parsePeaks(int start, int end, uint8_t *dest, size_t size)
 {
-  int i;
-  String value;
-  String inString = "";
-  int idx;
+  uint8_t &count = *dest;
+  Peak *peaks = reinterpret_cast<Peak *>(dest + PeakListOffset);
+  const size_t capacity = (size - PeakListOffset) / sizeof(Peak);
 
-  for (i = 0; i < len; i++)
+  if (lineGroup == 0)
   {
-    if (telegram[i] == '(')
+    memset(dest, 0, size); // no garbage between the values, the change is detected with memcmp
+  }
+  for (int i = start; i < end && count < capacity; i++)
+  {
+    if (telegram[i] != '(')
     {
-      break;
+      continue;
     }
-    if (isDigit(telegram[i]))
+    if (lineGroup >= 3)
     {
-      // convert the incoming byte to a char and add it to the string:
-      inString += (char)telegram[i];
+      switch ((lineGroup - 3) % 3)
+      {
+      case 1:
+        peaks[count].time = packTime(&telegram[i + 1], &telegram[end]);
+        break;
+      case 2:
+        peaks[count].value = FixedValue(&telegram[i + 1], &telegram[end]);
+        count++;
+        break;
+      }
     }
+    lineGroup++;
   }
+}
 
-  idx = inString.toInt();
-  
-  switch (idx)
+/// @brief Merge the log of the long power failures (1-0:99.97.0) :
+/// (count)(0-0:96.7.19) then, for each failure, (end)(duration*s)
+/// @param start position of the first '('
+/// @param end length of the line
+/// @param log failures already known
+/// The field is flagged when a failure is added : a memcmp of the log would also see its padding and its unused events
+void P1Reader::parsePowerFailures(int start, int end, PowerFailureLog &log)
+{
+  for (int i = start; i < end; i++)
   {
-  case 0:
-    break;
-  case 9614: // device type
-    readFirstParenthesisVal(i, len).toCharArray(DataReaded.P1version, sizeof(DataReaded.P1version));
-    break;
-  case 100:
-    readFirstParenthesisVal(i, len).toCharArray(DataReaded.P1timestamp, sizeof(DataReaded.P1timestamp));
-    break;
-  case 96140:
-    DataReaded.tariffIndicatorElectricity = readFirstParenthesisVal(i, len).toInt();
-    if (conf.InverseHigh_1_2_Tarif)
+    if (telegram[i] != '(')
     {
-      if (DataReaded.tariffIndicatorElectricity == 1)
+      continue;
+    }
+    if (lineGroup >= 2)
+    {
+      if (lineGroup % 2 == 0)
       {
-        DataReaded.tariffIndicatorElectricity = 2;
+        lineFailure.end = 0;
+        for (int n = i + 1; n < i + 13 && n < end && isDigit(telegram[n]); n++)
+        {
+          lineFailure.end = lineFailure.end * 10 + (telegram[n] - '0');
+        }
       }
       else
       {
-        DataReaded.tariffIndicatorElectricity = 1;
+        lineFailure.duration = parseFirstParenthesisUInt(i, end);
+        if (lineFailure.end != 0 && log.Add(lineFailure))
+        {
+          BackBuffer().changed |= 1ULL << lineField;
+        }
       }
     }
-    break;
-  case 9611:
-    readFirstParenthesisVal(i, len).toCharArray(DataReaded.equipmentId, sizeof(DataReaded.equipmentId));
-    break;
-  case 19610:
-    readFirstParenthesisVal(i, len).toCharArray(DataReaded.equipmentId2, sizeof(DataReaded.equipmentId2));
-    break;
-  case 9810:
-    //Maximum demand – Active energy import of the last 13 months
-    break;
-  case 10170: // 1-0:1.7.0 – actualElectricityPowerDelivered
-    DataReaded.actualElectricityPowerDeli = FixedValue(readUntilStar(i, len));
-    break;
-  case 10270: // 1-0:1.7.0 – actualElectricityPowerReturned
-    DataReaded.actualElectricityPowerRet = FixedValue(readUntilStar(i, len));
-    break;
-  case 10181: // 1-0:1.8.1(000992.992*kWh) Elektra verbruik laag tarief
-    if (!conf.InverseHigh_1_2_Tarif)
+    lineGroup++;
+  }
+}
+
+static uint8_t hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  c |= 0x20;
+  return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 0;
+}
+
+/// @brief Decode the text message (0-0:96.13.0), sent as hexadecimal (up to 1024 chars) :
+/// only the start that fits in the field is kept, the control chars are replaced by spaces
+/// @param start position of the '(' or of the rest of the value
+/// @param end length of the part of the line
+/// @param dest destination buffer, always null terminated
+/// @param size size of the destination buffer
+/// @return position of the first char not decoded (a pair of digits cut by the end of the buffer)
+int P1Reader::parseHexText(int start, int end, char *dest, size_t size)
+{
+  if (lineGroup == 0)
+  {
+    memset(dest, 0, size);
+  }
+  size_t len = strlen(dest);
+
+  int i = start;
+  while (i < end)
+  {
+    if (telegram[i] == '(')
     {
-      DataReaded.electricityUsedTariff1 = FixedValue(readUntilStar(i, len));
+      lineGroup++;
+      i++;
+      continue;
     }
-    else
+    if (lineGroup != 1 || telegram[i] == ')' || telegram[i] == '\r' || telegram[i] == '\n')
     {
-      DataReaded.electricityUsedTariff2 = FixedValue(readUntilStar(i, len));
+      return end; // end of the value
     }
-    break;
-  case 10182: // 1-0:1.8.2(000560.157*kWh) = Elektra verbruik hoog tarief
-    if (!conf.InverseHigh_1_2_Tarif)
+    if (i + 1 >= end)
     {
-      DataReaded.electricityUsedTariff2 = FixedValue(readUntilStar(i, len));
+      return i; // second digit in the next part
     }
-    else
+    char c = static_cast<char>((hexValue(telegram[i]) << 4) | hexValue(telegram[i + 1]));
+    if (len + 1 < size)
     {
-      DataReaded.electricityUsedTariff1 = FixedValue(readUntilStar(i, len));
+      dest[len++] = (static_cast<uint8_t>(c) < 0x20 || c == 0x7F) ? ' ' : c;
     }
-    break;
-  case 10281: // 1-0:2.8.1(000348.890*kWh) Elektra opbrengst laag tarief
-    if (!conf.InverseHigh_1_2_Tarif)
+    i += 2;
+  }
+  return i;
+}
+
+/// @brief Parse in place the value up to the unit separator ('*'), ex: (000992.992*kWh)
+/// @param start position of the '('
+/// @param end length of the line
+/// @return the value
+P1Reader::FixedValue P1Reader::parseUntilStar(int start, int end)
+{
+  return FixedValue(&telegram[start + 1], &telegram[end]);
+}
+
+/// @brief Parse the OBIS reference (A-B:C.D.E*F) at the start of the line
+/// @param len length of the line
+/// @param pos out: position of the first '(' (or len)
+/// @return the packed key, 0 if the reference is not valid
+uint64_t P1Reader::parseOBISReference(int len, int &pos)
+{
+  uint16_t groups[6] = {0, 0, 0, 0, 0, 255};
+  uint8_t group = 0;
+  bool digits = false;
+  bool valid = true;
+
+  for (pos = 0; pos < len && telegram[pos] != '('; pos++)
+  {
+    char c = telegram[pos];
+    if (isDigit(c))
     {
-      DataReaded.electricityReturnedTariff1 = FixedValue(readUntilStar(i, len));
+      groups[group] = groups[group] * 10 + (c - '0');
+      digits = true;
+      if (groups[group] > 255)
+      {
+        valid = false;
+        groups[group] = 0;
+      }
     }
-    else
+    else if (c == '-' && group == 0)
     {
-      DataReaded.electricityReturnedTariff2 = FixedValue(readUntilStar(i, len));
+      group = 1;
     }
-    break;
-  case 10282: // 1-0:2.8.2(000859.885*kWh) Elektra opbrengst hoog tarief
-    if (!conf.InverseHigh_1_2_Tarif)
+    else if (c == ':' && group == 1)
     {
-      DataReaded.electricityReturnedTariff2 = FixedValue(readUntilStar(i, len));
+      group = 2;
+    }
+    else if (c == '.' && (group == 2 || group == 3))
+    {
+      group++;
+    }
+    else if (c == '*' && group == 4)
+    {
+      group = 5;
+      groups[5] = 0;
+    }
+    else if (c != '\r' && c != '\n')
+    {
+      valid = false;
+    }
+  }
+
+  if (!digits || !valid)
+  {
+    return 0;
+  }
+  return OBISKey(groups[0], groups[1], groups[2], groups[3], groups[4], groups[5]);
+}
+
+/// @brief Binary search of the OBIS reference in OBISTable
+/// @param key packed OBIS reference
+/// @param entry out: the matching row
+/// @return true if found
+bool P1Reader::findOBISEntry(uint64_t key, OBISEntry &entry)
+{
+  size_t low = 0;
+  size_t high = OBISTableSize;
+
+  while (low < high)
+  {
+    size_t mid = (low + high) / 2;
+    memcpy_P(&entry, &OBISTable.rows[mid], sizeof(OBISEntry));
+
+    if (entry.key == key)
+    {
+      return true;
+    }
+    if (entry.key < key)
+    {
+      low = mid + 1;
     }
     else
     {
-      DataReaded.electricityReturnedTariff1 = FixedValue(readUntilStar(i, len));
+      high = mid;
     }
+  }
+  return false;
+}
+
+/// @brief Decode a line, or a part of a line longer than telegram[]
+/// @param len length of the line (or of the part)
+/// @param lastPart false if the line continues after this part
+/// @return chars decoded, the others must be given again at the start of the next part
+int P1Reader::OBISparser(int len, bool lastPart)
+{
+  int i = 0;
+  DataP1 &back = BackBuffer();
+  uint8_t *data = reinterpret_cast<uint8_t *>(&back);
+
+  if (!lineContinued && valueOnNextLine && telegram[0] == '(')
+  {
+    // value of the previous line (DSMR 2.2/3 gas), the entry of that line is still in lineEntry
+    valueOnNextLine = false;
+    *reinterpret_cast<FixedValue *>(data + lineOffset) = parseUntilStar(0, len);
+    if (memcmp(linePrevious, data + lineOffset, lineEntry.size) != 0)
+    {
+      back.changed |= 1ULL << lineField;
+    }
+    return len;
+  }
+
+  if (!lineContinued)
+  {
+    valueOnNextLine = false;
+    uint64_t key = parseOBISReference(len, i);
+    if (key == 0 || !findOBISEntry(key, lineEntry))
+    {
+      if (key != 0 || i < len)
+      {
+        MainSendDebugPrintf("[P1] Unrecognized line : %.*s", i, telegram);
+      }
+      lineEntry.type = OBISType::Ignore; // the rest of the line is skipped
+      lineEntry.size = 0;
+    }
+    if (lineEntry.type == OBISType::TimedNextLine && (meterFlags & MeterGasNextLine) == 0)
+    {
+      lineEntry.type = OBISType::Ignore; // not the gas format of this meter
+    }
+
+    lineOffset = lineEntry.offset;
+    lineField = lineEntry.field;
+    if (lineEntry.type == OBISType::Fixed && inverseTariff)
+    {
+      lineOffset = lineEntry.offsetAlt;
+      lineField = lineEntry.fieldAlt;
+    }
+    lineGroup = 0;
+    lineFailure = {};
+
+    // previous value, to flag the field if it changes
+    memcpy(linePrevious, data + lineOffset, lineEntry.size);
+  }
+  lineContinued = !lastPart;
+
+  int decoded = len;
+  if (!lastPart)
+  {
+    switch (lineEntry.type)
+    {
+    case OBISType::Ignore:
+    case OBISType::HexText:
+      break;
+    case OBISType::Peaks:
+    case OBISType::Failures:
+      // up to the last parenthesis : it can be cut
+      decoded = i;
+      for (int n = len - 1; n > i; n--)
+      {
+        if (telegram[n] == '(')
+        {
+          decoded = n;
+          break;
+        }
+      }
+      if (decoded > i)
+      {
+        break;
+      }
+      // a single value longer than the buffer
+      [[fallthrough]];
+    default:
+      MainSendDebugPrintf("[P1] Line too long : %.*s", i, telegram);
+      lineEntry.type = OBISType::Ignore;
+      break;
+    }
+  }
+
+  switch (lineEntry.type)
+  {
+  case OBISType::Ignore:
     break;
-  case 103170: // 1-0:31.7.0(002*A) Instantane stroom Elektriciteit L1
-    DataReaded.instantaneousCurrentL1 = FixedValue(readUntilStar(i, len));
-    break;
-  case 105170: // 1-0:51.7.0(002*A) Instantane stroom Elektriciteit L2
-    DataReaded.instantaneousCurrentL2 = FixedValue(readUntilStar(i, len));
-    break;
-  case 107170: // 1-0:71.7.0(002*A) Instantane stroom Elektriciteit L3
-    DataReaded.instantaneousCurrentL3 = FixedValue(readUntilStar(i, len));
-    break;
-  case 103270: // 1-0:32.7.0(232.0*V) Voltage L1
-    DataReaded.instantaneousVoltageL1 = FixedValue(readUntilStar(i, len));
-   break;
-  case 105270: // 1-0:52.7.0(232.0*V) Voltage L2
-    DataReaded.instantaneousVoltageL2 = FixedValue(readUntilStar(i, len));
-    break;
-  case 107270: // 1-0:72.7.0(232.0*V) Voltage L3
-    DataReaded.instantaneousVoltageL3 = FixedValue(readUntilStar(i, len));
-    break;
-  case 102170: // 1-0:21.7.0(002*A) Instantane stroom Elektriciteit L1
-    DataReaded.activePowerL1P = FixedValue(readUntilStar(i, len));
-   break;
-  case 104170: // 1-0:41.7.0(002*A) Instantane stroom Elektriciteit L2
-    DataReaded.activePowerL2P = FixedValue(readUntilStar(i, len));
-    break;
-  case 106170: // 1-0:61.7.0(002*A) Instantane stroom Elektriciteit L3
-    DataReaded.activePowerL3P = FixedValue(readUntilStar(i, len));
-    break;
-  case 102270: // 1-0:22.7.0(232.0*V) Voltage L1
-    DataReaded.activePowerL1NP = FixedValue(readUntilStar(i, len));
-   break;
-  case 104270: // 1-0:42.7.0(232.0*V) Voltage L2
-    DataReaded.activePowerL2NP = FixedValue(readUntilStar(i, len));
+  case OBISType::Text:
+    copyFirstParenthesisVal(i, len, reinterpret_cast<char *>(data + lineEntry.offset), lineEntry.size);
+    if (lineField == Field::P1timestamp)
+    {
+      back.epoch = parseTimestamp(i, len, back.utcOffset);
+    }
     break;
-  case 106270: // 1-0:62.7.0(232.0*V) Voltage L3
-    DataReaded.activePowerL3NP = FixedValue(readUntilStar(i, len));
+  case OBISType::HexText:
+    decoded = parseHexText(i, len, reinterpret_cast<char *>(data + lineEntry.offset), lineEntry.size);
     break;
-  case 1032320: // Aantal korte spanningsdalingen Elektriciteit in fase 1
-    DataReaded.numberVoltageSagsL1 = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::UInt:
+    *reinterpret_cast<uint32_t *>(data + lineEntry.offset) = parseFirstParenthesisUInt(i, len);
     break;
-  case 1052320: // Aantal korte spanningsdalingen Elektriciteit in fase 2
-   DataReaded.numberVoltageSagsL2 = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::Fixed:
+    *reinterpret_cast<FixedValue *>(data + lineOffset) = parseUntilStar(i, len);
+    meterAverage |= (lineField == Field::currentAverageDemand);
     break;
-  case 1072320: // Aantal korte spanningsdalingen Elektriciteit in fase 3
-    DataReaded.numberVoltageSagsL3 = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::Tariff:
+    back.tariffIndicatorElectricity = parseFirstParenthesisUInt(i, len);
+    if (inverseTariff)
+    {
+      if (back.tariffIndicatorElectricity == 1)
+      {
+        back.tariffIndicatorElectricity = 2;
+      }
+      else
+      {
+        back.tariffIndicatorElectricity = 1;
+      }
+    }
     break;
-  case 1032360: // 1-0:32.36.0(00000) Aantal korte spanningsstijgingen Elektriciteit in fase 1
-    DataReaded.numberVoltageSwellsL1 = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::Timed:
+  case OBISType::TimedNextLine:
+  {
+    char *time = reinterpret_cast<char *>(data + lineEntry.offsetAlt);
+    char previousTime[sizeof(DataP1::mbus1Time)];
+    static_assert(sizeof(DataP1::mbus1Time) == sizeof(DataP1::maximumDemandMonthTime), "capture times of the Timed fields must have the same size");
+    memcpy(previousTime, time, sizeof(previousTime));
+    copyFirstParenthesisVal(i, len, time, sizeof(previousTime));
+    if (memcmp(previousTime, time, sizeof(previousTime)) != 0)
+    {
+      back.changed |= 1ULL << lineEntry.fieldAlt;
+    }
+    if (lineEntry.type == OBISType::TimedNextLine)
+    {
+      valueOnNextLine = true;
+    }
+    else
+    {
+      *reinterpret_cast<FixedValue *>(data + lineEntry.offset) = parseUntilStar(findSecondParenthesis(i, len), len);
+    }
     break;
-  case 1052360: // 1-0:52.36.0(00000) Aantal korte spanningsstijgingen Elektriciteit in fase 2
-    DataReaded.numberVoltageSwellsL2 = readFirstParenthesisVal(i, len).toInt();
+  }
+  case OBISType::Capture:
     break;
-  case 1072360: // 1-0:72.36.0(00000) Aantal korte spanningsstijgingen Elektriciteit in fase 3
-    DataReaded.numberVoltageSwellsL3 = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::Peaks:
+    parsePeaks(i, decoded, data + lineEntry.offset, lineEntry.size);
     break;
-  case 12421: // gas
-    readBetweenDoubleParenthesis(i, len).toCharArray(DataReaded.gasReceived5min, sizeof(DataReaded.gasReceived5min));
-    readBetweenDoubleParenthesis(i, len).toCharArray(DataReaded.gasDomoticz, sizeof(DataReaded.gasDomoticz));
+  case OBISType::Failures:
+    parsePowerFailures(i, decoded, *reinterpret_cast<PowerFailureLog *>(data + lineEntry.offset));
     break;
-  case 96721: // 0-0:96.7.21(00051)  Number of power failures in any phase
-    DataReaded.numberPowerFailuresAny = readFirstParenthesisVal(i, len).toInt();
+  }
+
+  if (lastPart && lineEntry.type != OBISType::Failures && memcmp(linePrevious, data + lineOffset, lineEntry.size) != 0)
+  {
+    back.changed |= 1ULL << lineField;
+  }
+  return decoded;
+}
+
+P1Reader::FieldInfo P1Reader::GetFieldInfo(uint8_t field)
+{
+  FieldInfo info;
+  memcpy_P(&info, &FieldTable[field], sizeof(FieldInfo));
+  return info;
+}
+
+size_t P1Reader::FieldToChars(const DataP1 &data, const FieldInfo &info, char *buffer, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  const uint8_t *value = reinterpret_cast<const uint8_t *>(&data) + info.offset;
+  int len = 0;
+  switch (info.type)
+  {
+  case OBISType::Text:
+  case OBISType::HexText:
+  case OBISType::Capture:
+    len = snprintf(buffer, size, "%s", reinterpret_cast<const char *>(value));
     break;
-  case 9679: // 0-0:96.7.9(00007) Number of long power failures in any phase
-    DataReaded.numberLongPowerFailuresAny = readFirstParenthesisVal(i, len).toInt();
+  case OBISType::UInt:
+  case OBISType::Tariff:
+    len = snprintf(buffer, size, "%u", static_cast<unsigned int>(*reinterpret_cast<const uint32_t *>(value)));
     break;
-  case 1099970: // 1-0:99.97.0(6) Power Failure Event Log (long power failures)
-    DataReaded.longPowerFailuresLog = "";
-    while (i < len)
+  case OBISType::Fixed:
+  case OBISType::Timed:
+  case OBISType::TimedNextLine:
+    return reinterpret_cast<const FixedValue *>(value)->toChars(buffer, size);
+  case OBISType::Peaks:
+  {
+    // JSON array : [{"time":"2308231925","value":3.695},...]
+    uint8_t count = *value;
+    const Peak *peaks = reinterpret_cast<const Peak *>(value + PeakListOffset);
+    size_t pos = snprintf(buffer, size, "[");
+    for (uint8_t n = 0; n < count && pos + 1 < size; n++)
     {
-      DataReaded.longPowerFailuresLog += (char)telegram[i];
-      i++;
+      char number[21];
+      peaks[n].value.toChars(number, sizeof(number));
+      pos += snprintf(&buffer[pos], size - pos, "%s{\"time\":\"%010u\",\"value\":%s}", (n == 0) ? "" : ",", static_cast<unsigned int>(peaks[n].time), number);
     }
+    if (pos + 1 < size)
+    {
+      pos += snprintf(&buffer[pos], size - pos, "]");
+    }
+    len = pos;
     break;
-    case 10140:
-    case 10160:
-    case 96310:
-    case 1700:
-    case 103140:
-    case 96130:
-    //ignore line :-)
+  }
+  case OBISType::Failures:
+  {
+    // JSON array : [{"end":"231029141507","duration":240},...]
+    const PowerFailureLog &log = *reinterpret_cast<const PowerFailureLog *>(value);
+    size_t pos = snprintf(buffer, size, "[");
+    for (uint8_t n = 0; n < log.count && pos + 1 < size; n++)
+    {
+      pos += snprintf(&buffer[pos], size - pos, "%s{\"end\":\"%012llu\",\"duration\":%u}", (n == 0) ? "" : ",", static_cast<unsigned long long>(log.event[n].end), static_cast<unsigned int>(log.event[n].duration));
+    }
+    if (pos + 1 < size)
+    {
+      pos += snprintf(&buffer[pos], size - pos, "]");
+    }
+    len = pos;
     break;
-  default:
-    MainSendDebugPrintf("[P1] Unrecognized line : %s", inString);
+  }
+  case OBISType::Ignore:
+    buffer[0] = '\0';
     break;
   }
-  // clear the string for new input:
-  inString = "";
+  return (len < 0) ? 0 : std::min<size_t>(len, size - 1);
+}
+
+bool P1Reader::fullReportDue(Delegate &delegate)
+{
+  if (conf.sendOnlyChanged && !delegate.fullNeeded && (conf.fullRefresh == 0 || millis() - delegate.lastFull < conf.fullRefresh * 1000UL))
+  {
+    return false;
+  }
+  delegate.fullNeeded = false;
+  delegate.lastFull = millis();
+  return true;
+}
+
+const char *P1Reader::FieldText(const DataP1 &data, const FieldInfo &info)
+{
+  if (info.type != OBISType::Text && info.type != OBISType::HexText && info.type != OBISType::Capture)
+  {
+    return nullptr;
+  }
+  return reinterpret_cast<const char *>(&data) + info.offset;
+}
+
+size_t P1Reader::OBISToChars(uint64_t key, char *buffer, size_t size)
+{
+  int len = snprintf(buffer, size, "%u-%u:%u.%u.%u", static_cast<unsigned int>((key >> 40) & 0xFF), static_cast<unsigned int>((key >> 32) & 0xFF), static_cast<unsigned int>((key >> 24) & 0xFF), static_cast<unsigned int>((key >> 16) & 0xFF), static_cast<unsigned int>((key >> 8) & 0xFF));
+  if (len < 0 || size == 0)
+  {
+    return 0;
+  }
+  return std::min<size_t>(len, size - 1);
+}
+
+bool P1Reader::MBusPresent(const DataP1 &data, uint8_t channel)
+{
+  FieldInfo info = GetFieldInfo(MBusField(channel, Field::mbus1Time));
+  return *(reinterpret_cast<const char *>(&data) + info.offset) != '\0';
+}
+
+bool P1Reader::FieldPresent(const DataP1 &data, const FieldInfo &info)
+{
+  uint8_t channel = (info.obis >> 32) & 0xFF; // B group : 1 to 4 for the M-Bus devices
+  return channel == 0 || MBusPresent(data, channel);
+}
+
+uint8_t P1Reader::GasChannel(const DataP1 &data)
+{
+  bool typeSent = false;
+  for (uint8_t channel = 1; channel <= P1MBUSCHANNELS; channel++)
+  {
+    FieldInfo info = GetFieldInfo(MBusField(channel, Field::mbus1Type));
+    uint32_t type = *reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(&data) + info.offset);
+    if (type == MBUS_DEVICE_GAS && MBusPresent(data, channel))
+    {
+      return channel;
+    }
+    typeSent |= (type != 0);
+  }
+  return (!typeSent && MBusPresent(data, 1)) ? 1 : 0;
+}
+
+/// @brief Capacity tariff (Belgium) : the grid fee depends on the highest quarter-hour average power of the month.
+/// Follow the average of the current quarter (1-0:1.4.0, or from the import counters if the meter does not send it),
+/// forecast its value at the end of the quarter with the actual power, and keep the highest quarters of the month.
+void P1Reader::UpdateCapacity(DataP1 &data)
+{
+  if (data.epoch == 0)
+  {
+    return;
+  }
+  // the quarters of the local time start at the same seconds as in UTC (offsets of whole hours)
+  uint32_t quarter = data.epoch / 900;
+  int64_t elapsed = data.epoch % 900; // seconds since the start of the quarter
+  int64_t energy = data.electricityUsedTariff1.int_val() + data.electricityUsedTariff2.int_val(); // Wh
+  int64_t power = data.actualElectricityPowerDeli.int_val();                                       // W
+
+  if (quarter != capacityQuarter)
+  {
+    uint32_t quarterTime = localToDecimal(data.epoch - elapsed + data.utcOffset);
+    // the last average of the previous quarter is its final value (at one interval of reading)
+    if (capacityQuarter != 0 && quarterAverage >= 0)
+    {
+      if (capacityQuarterTime / 1000000 != quarterTime / 1000000)
+      {
+        data.monthPeaks.count = 0; // new month
+        data.changed |= 1ULL << Field::monthPeaks;
+      }
+      else
+      {
+        Peak peak = {capacityQuarterTime, FixedValue::FromMilli(quarterAverage)};
+        uint8_t pos = data.monthPeaks.count;
+        const uint8_t capacity = sizeof(data.monthPeaks.peak) / sizeof(Peak);
+        while (pos > 0 && data.monthPeaks.peak[pos - 1].value.int_val() < peak.value.int_val())
+        {
+          if (pos < capacity)
+          {
+            data.monthPeaks.peak[pos] = data.monthPeaks.peak[pos - 1];
+          }
+          pos--;
+        }
+        if (pos < capacity)
+        {
+          data.monthPeaks.peak[pos] = peak;
+          data.monthPeaks.count = std::min<uint8_t>(data.monthPeaks.count + 1, capacity);
+          data.changed |= 1ULL << Field::monthPeaks;
+        }
+      }
+    }
+
+    // energy at the start of the quarter, known only if the quarter started just before (one minute)
+    quarterStartEnergy = (elapsed <= 60) ? energy - (power * elapsed) / 3600 : -1;
+    capacityQuarter = quarter;
+    capacityQuarterTime = quarterTime;
+  }
+
+  // energy of the quarter so far in W.s
+  int64_t quarterEnergy;
+  if (meterAverage)
+  {
+    quarterEnergy = data.currentAverageDemand.int_val() * elapsed;
+  }
+  else if (quarterStartEnergy >= 0)
+  {
+    quarterEnergy = (energy - quarterStartEnergy) * 3600;
+  }
+  else
+  {
+    quarterAverage = -1;
+    return;
+  }
+  quarterAverage = (elapsed > 0) ? quarterEnergy / elapsed : power;
+
+  // currentAverageDemand stays the value of the meter : the average computed on the module has its own field
+  FixedValue average = FixedValue::FromMilli(quarterAverage);
+  if (average != data.quarterAverageDemand)
+  {
+    data.quarterAverageDemand = average;
+    data.changed |= 1ULL << Field::quarterAverageDemand;
+  }
+
+  // the actual power until the end of the quarter
+  FixedValue forecast = FixedValue::FromMilli((quarterEnergy + power * (900 - elapsed)) / 900);
+  if (forecast != data.quarterForecast)
+  {
+    data.quarterForecast = forecast;
+    data.changed |= 1ULL << Field::quarterForecast;
+  }
 }
 
 unsigned long P1Reader::GetnextUpdateTime()
@@ -455,6 +1204,8 @@ bool P1Reader::CheckTimeout()
   return false;
 }
 
+/// @brief Build the lines from the bytes already received by the UART, never wait for the meter.
+/// A line not complete stays in telegram[] and is continued at the next call.
 void P1Reader::readTelegram()
 {
   if (state != State::WAITING && state != State::READING)
@@ -467,28 +1218,127 @@ void P1Reader::readTelegram()
     return;
   }
 
-  if (Serial.available())
+  // only what is in the RX buffer now, a meter that sends without stop can't hold the loop
+  int available = Serial.available();
+  if (decryptor.Enabled())
+  {
+    readEncrypted(available);
+    return;
+  }
+  while (available-- > 0)
+  {
+    int c = Serial.read();
+    if (c < 0 || readChar(c))
+    {
+      return;
+    }
+  }
+}
+
+/// @brief Encrypted frames (Smarty) : decrypted by chunks as they are received, the plaintext goes to the lines
+/// as a datagram in clear. A chunk never crosses the end of a frame : the next one stays in the RX buffer.
+/// @param available bytes in the RX buffer
+void P1Reader::readEncrypted(int available)
+{
+  uint8_t chunk[64];
+  while (available > 0)
   {
-    memset(telegram, 0, sizeof(telegram));
-    while (Serial.available())
+    size_t len = Serial.read(chunk, std::min({sizeof(chunk), static_cast<size_t>(available), decryptor.Wanted()}));
+    if (len == 0)
     {
-      if (CheckTimeout())
+      return;
+    }
+    available -= len;
+
+    int plain = decryptor.Decrypt(chunk, len);
+    if (plain < 0)
+    {
+      if (plain == P1TAGERROR)
+      {
+        MainSendDebug("[P1] Encrypted frame rejected (wrong key ?), datagram dropped");
+      }
+      else
+      {
+        MainSendDebug("[P1] Encrypted frame header not valid (framing error), datagram dropped");
+      }
+      lineLength = 0;
+      lineContinued = false;
+      crcRunning = false;
+      dataEnd = false;
+      state = State::WAITING;
+      continue;
+    }
+    for (int n = 0; n < plain; n++)
+    {
+      if (readChar(chunk[n]))
       {
         return;
       }
+    }
+  }
+}
 
-      int len = Serial.readBytesUntil('\n', telegram, sizeof(telegram)-2);
-      telegram[len] = '\n';
-      telegram[len + 1] = 0;
-      
-      decodeTelegram(len + 1);
+/// @brief Add a received char to the line, decode the line when it is complete
+/// @return true when the datagram is complete (state DONE)
+bool P1Reader::readChar(int c)
+{
+  // CRC from the '/' to the '!' (both included)
+  if (c == '/')
+  {
+    crc = 0;
+    crcRunning = true;
+  }
+  if (crcRunning)
+  {
+    crc = CRC16Update(crc, c);
+    crcRunning = (c != '!');
+  }
 
-      if (state == State::DONE)
-      {
-        blink(1, 400);
-        RTS_off();
-        TriggerCallbacks();
-      }
+  if (c != '\n')
+  {
+    telegram[lineLength++] = static_cast<char>(c);
+    if (lineLength >= sizeof(telegram) - 2)
+    {
+      // line too long for the buffer : decoded in parts
+      decodeLinePart();
     }
+    return false;
   }
-}
\ No newline at end of file
+
+  telegram[lineLength] = '\n';
+  telegram[lineLength + 1] = 0;
+  int len = lineLength + 1;
+  lineLength = 0;
+
+  if (lineContinued)
+  {
+    // end of a long line, never the start or the end of the datagram
+    if (state == State::READING)
+    {
+      appendRaw(telegram, len);
+      OBISparser(len, true);
+    }
+    return false;
+  }
+  decodeTelegram(len);
+
+  if (state == State::DONE)
+  {
+    if (conf.continuousRead)
+    {
+      // Data Request stay high, wait the next datagram (one per second)
+      digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+      state = State::WAITING;
+      TimeOutRead = millis() + P1TIMEOUTREAD;
+      nextUpdateTime = millis() + 1000;
+    }
+    else
+    {
+      blink(1, 400);
+      RTS_off();
+    }
+    TriggerCallbacks();
+    return true;
+  }
+  return false;
+}
@@ -28,9 +28,102 @@
 #include <Arduino.h>
 #include "GlobalVar.h"
 #include "Debug.h"
+#include "P1History.h"
+#include "P1Decryptor.h"
 
-#define MAXLINELENGTH 1037 // 0-0:96.13.0 has a maximum lenght of 1024 chars + 11 of its identifier + end line (2char)
+#define P1LINEBUFFER 128 // line buffer : the longer lines (0-0:96.13.0 up to 1024 chars, 0-0:98.1.0, 1-0:99.97.0) are decoded in parts
 #define P1TIMEOUTREAD 10000
+#define P1RXBUFFERSIZE 2048 // UART RX buffer (filled by interrupt) : a whole DSMR5 telegram, i.e. one second of the meter at 115200 baud
+#define P1FIELDMAXCHARS 512 // longest text of a field written by FieldToChars (13 peaks of 0-0:98.1.0 in JSON), null included
+#define P1MBUSCHANNELS 4    // M-Bus devices (gas, water, heat) connected to the meter : 0-1 to 0-4
+#define MBUS_DEVICE_GAS 3   // device type (0-n:24.1.0) of a gas meter
+#define P1POWERFAILURES 10  // long power failures kept (the meter sends up to 10)
+#define P1UTCOFFSET 3600    // standard time of the meters (CET) in seconds, one hour more in summer (0-0:1.0.0 ending by S)
+
+/// @brief Pack an OBIS reference A-B:C.D.E*F in a single key (F = 255 when not given)
+constexpr uint64_t OBISKey(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f = 255)
+{
+  return (static_cast<uint64_t>(a) << 40) | (static_cast<uint64_t>(b) << 32) | (static_cast<uint64_t>(c) << 24) | (static_cast<uint64_t>(d) << 16) | (static_cast<uint64_t>(e) << 8) | f;
+}
+
+/// @brief Schema of the values of a datagram, one line per value. Everything else is generated from it :
+/// DataP1, the bits of DataP1::changed, the OBIS table of the parser and the outputs (MQTT, P1.json, Domoticz, Telnet).
+/// X(field, type, size, A, B, C, D, E, alt, mqtt, jsonGroup, json, unit, domoticz)
+///  - type : see P1Reader::OBISType, size : chars for Text and Capture, peaks for Peaks
+///  - alt : destination when the tariffs are swapped (see P1Reader::inverseTariff), capture time for Timed (the field itself if none)
+///  - mqtt : topic under conf.mqttTopic, jsonGroup/json : place in P1.json ("" = not sent)
+///  - domoticz : position in the sValue of the "P1 Smart Meter" device (0 = not sent)
+#define P1_METER_FIELDS(X) \
+  X(P1timestamp,                Text,   13, 0, 0, 1,  0,  0,  P1timestamp,                "reading/timestamp",                      "",  "",                "",    0) \
+  X(equipmentId,                Text,  100, 0, 0, 96, 1,  1,  equipmentId,                "equipmentID",                            "",  "",                "",    0) \
+  X(P1version,                  Text,    8, 0, 0, 96, 1,  4,  P1version,                  "meter-stats/dsmr_version",               "",  "",                "",    0) \
+  X(numberLongPowerFailuresAny, UInt,    0, 0, 0, 96, 7,  9,  numberLongPowerFailuresAny, "meter-stats/long_power_failure_count",   "",  "",                "",    0) \
+  X(numberPowerFailuresAny,     UInt,    0, 0, 0, 96, 7,  21, numberPowerFailuresAny,     "meter-stats/power_failure_count",        "",  "",                "",    0) \
+  X(tariffIndicatorElectricity, Tariff,  0, 0, 0, 96, 14, 0,  tariffIndicatorElectricity, "meter-stats/electricity_tariff",         "",  "",                "",    0) \
+  X(textMessage,                HexText,65, 0, 0, 96, 13, 0,  textMessage,                "meter-stats/text_message",               "",  "TextMessage",     "",    0) \
+  X(maximumDemandHistory,       Peaks,  13, 0, 0, 98, 1,  0,  maximumDemandHistory,       "capacity/history",                       "Capacity", "History",    "kW",  0) \
+  P1_MBUS_FIELDS(X, 1) \
+  P1_MBUS_FIELDS(X, 2) \
+  P1_MBUS_FIELDS(X, 3) \
+  P1_MBUS_FIELDS(X, 4) \
+  X(currentAverageDemand,       Fixed,   0, 1, 0, 1,  4,  0,  currentAverageDemand,       "capacity/current_average_demand",        "Capacity", "Average",    "kW",  0) \
+  X(maximumDemandMonth,         Timed,   0, 1, 0, 1,  6,  0,  maximumDemandMonthTime,     "capacity/month_peak",                    "Capacity", "MonthPeak",  "kW",  0) \
+  X(maximumDemandMonthTime,     Capture,13, 1, 0, 1,  6,  0,  maximumDemandMonthTime,     "capacity/month_peak_time",               "Capacity", "MonthPeakTime", "", 0) \
+  X(actualElectricityPowerDeli, Fixed,   0, 1, 0, 1,  7,  0,  actualElectricityPowerDeli, "reading/electricity_currently_delivered", "",  "TA",              "kW",  5) \
+  X(electricityUsedTariff1,     Fixed,   0, 1, 0, 1,  8,  1,  electricityUsedTariff2,     "reading/electricity_delivered_1",        "",  "T1",              "kWh", 1) \
+  X(electricityUsedTariff2,     Fixed,   0, 1, 0, 1,  8,  2,  electricityUsedTariff1,     "reading/electricity_delivered_2",        "",  "T2",              "kWh", 2) \
+  X(actualElectricityPowerRet,  Fixed,   0, 1, 0, 2,  7,  0,  actualElectricityPowerRet,  "reading/electricity_currently_returned",  "",  "RTA",             "kW",  6) \
+  X(electricityReturnedTariff1, Fixed,   0, 1, 0, 2,  8,  1,  electricityReturnedTariff2, "reading/electricity_returned_1",         "",  "RT1",             "kWh", 3) \
+  X(electricityReturnedTariff2, Fixed,   0, 1, 0, 2,  8,  2,  electricityReturnedTariff1, "reading/electricity_returned_2",         "",  "RT2",             "kWh", 4) \
+  X(activePowerL1P,             Fixed,   0, 1, 0, 21, 7,  0,  activePowerL1P,             "reading/phase_currently_delivered_l1",   "",  "",                "kW",  0) \
+  X(activePowerL1NP,            Fixed,   0, 1, 0, 22, 7,  0,  activePowerL1NP,            "reading/phase_currently_returned_l1",    "",  "",                "kW",  0) \
+  X(instantaneousCurrentL1,     Fixed,   0, 1, 0, 31, 7,  0,  instantaneousCurrentL1,     "",                                       "A", "L1",              "A",   0) \
+  X(instantaneousVoltageL1,     Fixed,   0, 1, 0, 32, 7,  0,  instantaneousVoltageL1,     "reading/phase_voltage_l1",               "V", "L1",              "V",   0) \
+  X(numberVoltageSagsL1,        UInt,    0, 1, 0, 32, 32, 0,  numberVoltageSagsL1,        "meter-stats/short_power_drops",          "",  "",                "",    0) \
+  X(numberVoltageSwellsL1,      UInt,    0, 1, 0, 32, 36, 0,  numberVoltageSwellsL1,      "meter-stats/short_power_peaks",          "",  "",                "",    0) \
+  X(activePowerL2P,             Fixed,   0, 1, 0, 41, 7,  0,  activePowerL2P,             "reading/phase_currently_delivered_l2",   "",  "",                "kW",  0) \
+  X(activePowerL2NP,            Fixed,   0, 1, 0, 42, 7,  0,  activePowerL2NP,            "reading/phase_currently_returned_l2",    "",  "",                "kW",  0) \
+  X(instantaneousCurrentL2,     Fixed,   0, 1, 0, 51, 7,  0,  instantaneousCurrentL2,     "",                                       "A", "L2",              "A",   0) \
+  X(instantaneousVoltageL2,     Fixed,   0, 1, 0, 52, 7,  0,  instantaneousVoltageL2,     "reading/phase_voltage_l2",               "V", "L2",              "V",   0) \
+  X(numberVoltageSagsL2,        UInt,    0, 1, 0, 52, 32, 0,  numberVoltageSagsL2,        "",                                       "",  "",                "",    0) \
+  X(numberVoltageSwellsL2,      UInt,    0, 1, 0, 52, 36, 0,  numberVoltageSwellsL2,      "",                                       "",  "",                "",    0) \
+  X(activePowerL3P,             Fixed,   0, 1, 0, 61, 7,  0,  activePowerL3P,             "reading/phase_currently_delivered_l3",   "",  "",                "kW",  0) \
+  X(activePowerL3NP,            Fixed,   0, 1, 0, 62, 7,  0,  activePowerL3NP,            "reading/phase_currently_returned_l3",    "",  "",                "kW",  0) \
+  X(instantaneousCurrentL3,     Fixed,   0, 1, 0, 71, 7,  0,  instantaneousCurrentL3,     "",                                       "A", "L3",              "A",   0) \
+  X(instantaneousVoltageL3,     Fixed,   0, 1, 0, 72, 7,  0,  instantaneousVoltageL3,     "reading/phase_voltage_l3",               "V", "L3",              "V",   0) \
+  X(numberVoltageSagsL3,        UInt,    0, 1, 0, 72, 32, 0,  numberVoltageSagsL3,        "",                                       "",  "",                "",    0) \
+  X(numberVoltageSwellsL3,      UInt,    0, 1, 0, 72, 36, 0,  numberVoltageSwellsL3,      "",                                       "",  "",                "",    0) \
+  X(longPowerFailuresLog,       Failures,0, 1, 0, 99, 97, 0,  longPowerFailuresLog,       "meter-stats/power_failures",             "",  "PowerFailures",   "s",   0)
+
+/// @brief Values computed on the module (capacity tariff, see P1Reader::UpdateCapacity()), same columns as P1_METER_FIELDS.
+/// The OBIS reference is the one they come from, they are not in the OBIS table.
+#define P1_COMPUTED_FIELDS(X) \
+  X(quarterAverageDemand,       Fixed,   0, 1, 0, 1,  4,  0,  quarterAverageDemand,       "capacity/quarter_average_demand",        "Capacity", "QuarterAverage", "kW", 0) \
+  X(quarterForecast,            Fixed,   0, 1, 0, 1,  4,  0,  quarterForecast,            "capacity/quarter_forecast",              "Capacity", "Forecast",   "kW",  0) \
+  X(monthPeaks,                 Peaks,   3, 1, 0, 1,  6,  0,  monthPeaks,                 "capacity/month_top_peaks",               "Capacity", "MonthTop",   "kW",  0)
+
+#define P1_FIELDS(X) P1_METER_FIELDS(X) P1_COMPUTED_FIELDS(X)
+
+/// @brief Values of the M-Bus channel n, same columns as P1_FIELDS (keep the four fields in this order, see P1Reader::MBusField())
+#define P1_MBUS_FIELDS(X, n) \
+  X(mbus##n##Type,  UInt,     0, 0, n, 24, 1, 0, mbus##n##Type,  "mbus/" #n "/device_type",  "MBus" #n, "Type",  "", 0) \
+  X(mbus##n##Id,    Text,    97, 0, n, 96, 1, 0, mbus##n##Id,    "mbus/" #n "/equipment_id", "MBus" #n, "Id",    "", 0) \
+  X(mbus##n##Time,  Capture, 13, 0, n, 24, 2, 1, mbus##n##Time,  "mbus/" #n "/timestamp",    "MBus" #n, "Time",  "", 0) \
+  X(mbus##n##Value, Timed,    0, 0, n, 24, 2, 1, mbus##n##Time,  "mbus/" #n "/reading",      "MBus" #n, "Value", "", 0)
+
+// storage of each type in DataP1
+#define P1_STORAGE_Text(field, size) char field[size]
+#define P1_STORAGE_Capture(field, size) char field[size]
+#define P1_STORAGE_HexText(field, size) char field[size]
+#define P1_STORAGE_Timed(field, size) FixedValue field
+#define P1_STORAGE_Peaks(field, size) PeakList<size> field
+#define P1_STORAGE_UInt(field, size) uint32_t field
+#define P1_STORAGE_Tariff(field, size) uint32_t field
+#define P1_STORAGE_Fixed(field, size) FixedValue field
+#define P1_STORAGE_Failures(field, size) PowerFailureLog field
+#define P1_FIELD_STORAGE(field, type, size, ...) P1_STORAGE_##type(field, size);
+#define P1_FIELD_BIT(field, ...) field,
+#define P1_FIELD_SIZEOF(field, ...) sizeof(DataP1::field),
 
 enum class State {
   DISABLED,
@@ -44,99 +137,444 @@ class P1Reader
 {
 public:
   State state = State::DISABLED;
-  unsigned long LastSample = 0;
   explicit P1Reader(settings &currentConf);
   unsigned long GetnextUpdateTime();
-  char telegram[MAXLINELENGTH] = {}; // holds a single line of the datagram
-  String datagram;                   // holds entire datagram for raw output
+  char telegram[P1LINEBUFFER] = {}; // holds a line of the datagram, or the part of a long line not decoded yet
+  size_t lineLength = 0;             // chars of the current line already received
+  uint16_t crc = 0;                  // CRC16 of the datagram, updated for each byte received from '/' to '!'
+  bool crcRunning = false;
   String meterName = "";
+  uint8_t meterFlags = 0;  // MeterFlag of the meter, known after the first header
+  bool inverseTariff = false; // tariff 1 and 2 swapped (meter profile or conf.tariffOrder)
   bool dataEnd = false; // signals that we have found the end char in the data (!)
+  uint32_t crcErrors = 0; // datagrams rejected because of a bad CRC
   void DoMe();
   void readTelegram();
+
+  /// @brief Last raw datagrams received, to replay an incident. The last one (ReplayLast) is the raw
+  /// datagram (/raw, telnet), kept while the next one is received.
+  const P1History &GetHistory() const
+  {
+    return history;
+  }
+
   void ResetnextUpdateTime();
 
-  /// @brief value that is parsed as a three-decimal float, but stored as an
-  // integer (by multiplying by 1000). Supports val() (or implicit cast to
-  // float) to get the original value, and int_val() to get the more
-  // efficient integer value. The unit() and int_unit() methods on
-  // FixedField return the corresponding units for these values.
+  /// @brief Decimal value of the meter stored as a signed integer of milli-units (ex: 000992.992 -> 992992).
+  // Parsed and formatted without float (the ESP8266 has no FPU), so large counters stay exact.
+  // int_val() gives the milli-units, toChars() the text with three decimals.
   struct FixedValue
   {
     FixedValue() = default;
-    explicit FixedValue(String value) : _value(value.toFloat() * 1000) {}
 
-    operator float() const { return _value * 0.001f; }
-    float val() const { return _value * 0.001f; }
+    /// @brief Value computed on the module
+    /// @param milli value in milli-units
+    static FixedValue FromMilli(int64_t milli)
+    {
+      FixedValue value;
+      value._value = milli;
+      return value;
+    }
+
+    /// @brief Parse in place a decimal value (ex: 000992.992), stop on the first char that is not part of the number
+    /// Decimals after the third one are dropped.
+    /// @param value first char of the value
+    /// @param end end of the buffer (excluded)
+    FixedValue(const char *value, const char *end)
+    {
+      bool negative = false;
+      int64_t integer = 0;
+      int64_t milli = 0;
+      int8_t decimals = -1; // -1 : not in the decimals
+
+      if (value < end && (*value == '-' || *value == '+'))
+      {
+        negative = (*value == '-');
+        value++;
+      }
+
+      for (; value < end; value++)
+      {
+        if (*value == '.' && decimals < 0)
+        {
+          decimals = 0;
+        }
+        else if (*value >= '0' && *value <= '9')
+        {
+          if (decimals < 0)
+          {
+            if (integer < 1000000000000000LL)
+            {
+              integer = integer * 10 + (*value - '0');
+            }
+          }
+          else if (decimals < 3)
+          {
+            milli = milli * 10 + (*value - '0');
+            decimals++;
+          }
+        }
+        else
+        {
+          break;
+        }
+      }
+
+      for (; decimals < 3; decimals++)
+      {
+        milli *= 10;
+      }
+
+      _value = integer * 1000 + milli;
+      if (negative)
+      {
+        _value = -_value;
+      }
+    }
+
+    bool operator==(const FixedValue &other) const { return _value == other._value; }
+    bool operator!=(const FixedValue &other) const { return _value != other._value; }
+    int64_t int_val() const { return _value; }
+
+    /// @brief Write the value with three decimals (ex: 992.992)
+    /// @param buffer destination, always null terminated
+    /// @param size size of the destination (21 chars is always enough)
+    /// @return length written
+    size_t toChars(char *buffer, size_t size) const
+    {
+      char digits[20];
+      uint8_t count = 0;
+      uint64_t value = (_value < 0) ? -static_cast<uint64_t>(_value) : _value;
+
+      do
+      {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+      } while (value != 0 || count < 4); // at least 0.000
+
+      size_t len = 0;
+      if (_value < 0 && len + 1 < size)
+      {
+        buffer[len++] = '-';
+      }
+      while (count > 0 && len + 1 < size)
+      {
+        buffer[len++] = digits[--count];
+        if (count == 3 && len + 1 < size)
+        {
+          buffer[len++] = '.';
+        }
+      }
+      buffer[len] = '\0';
+      return len;
+    }
 
   private:
-    uint32_t _value = 0;
+    int64_t _value = 0;
+  };
+
+  /// @brief Quarter-hour peak of power
+  struct Peak
+  {
+    uint32_t time;    // start of the peak, YYMMDDhhmm as a decimal number
+    FixedValue value; // average power of the quarter (kW)
+  };
+
+  /// @brief List of up to N peaks
+  template <uint8_t N>
+  struct PeakList
+  {
+    uint8_t count;
+    Peak peak[N];
+  };
+
+  /// @brief Long power failure
+  struct PowerFailure
+  {
+    uint64_t end;      // end of the failure, YYMMDDhhmmss as a decimal number
+    uint32_t duration; // seconds
   };
 
+  /// @brief The P1POWERFAILURES most recent long power failures, from the oldest.
+  /// The meter sends its own log in each datagram : the failures already known are skipped, the oldest is dropped when full.
+  struct PowerFailureLog
+  {
+    uint8_t count;
+    PowerFailure event[P1POWERFAILURES];
+
+    /// @brief Add a failure if it is not known yet
+    /// @return true if added
+    bool Add(const PowerFailure &failure)
+    {
+      uint8_t pos = count;
+      while (pos > 0 && event[pos - 1].end >= failure.end)
+      {
+        if (event[pos - 1].end == failure.end && event[pos - 1].duration == failure.duration)
+        {
+          return false;
+        }
+        pos--;
+      }
+      if (count == P1POWERFAILURES)
+      {
+        if (pos == 0)
+        {
+          return false; // older than the whole log
+        }
+        memmove(&event[0], &event[1], (pos - 1) * sizeof(PowerFailure));
+        pos--;
+      }
+      else
+      {
+        memmove(&event[pos + 1], &event[pos], (count - pos) * sizeof(PowerFailure));
+        count++;
+      }
+      event[pos] = failure;
+      return true;
+    }
+  };
+
+  /// @brief Bit of each value of DataP1 in DataP1::changed (same names as the fields), also the index in the field table
+  struct Field
+  {
+    enum : uint8_t
+    {
+      P1_FIELDS(P1_FIELD_BIT)
+      Count
+    };
+  };
+  static_assert(Field::Count <= 64, "DataP1::changed is a 64 bits mask");
+  static constexpr uint64_t AllFields = (Field::Count == 64) ? ~0ULL : (1ULL << Field::Count) - 1;
+
   struct DataP1
   {
-    char gasReceived5min[12];
-    char gasDomoticz[12]; // Domoticz wil gas niet in decimalen?
-    char P1version[8];
-    char P1timestamp[13] = "\0";
-    char equipmentId[100] = "\0";
-    char equipmentId2[100] = "\0";
-    FixedValue electricityUsedTariff1;
-    FixedValue electricityUsedTariff2;
-    FixedValue electricityReturnedTariff1;
-    FixedValue electricityReturnedTariff2;
-    uint32_t tariffIndicatorElectricity;
-    uint32_t numberPowerFailuresAny;
-    uint32_t numberLongPowerFailuresAny;
-    String longPowerFailuresLog;
-    uint32_t numberVoltageSagsL1;
-    uint32_t numberVoltageSagsL2;
-    uint32_t numberVoltageSagsL3;
-    uint32_t numberVoltageSwellsL1;
-    uint32_t numberVoltageSwellsL2;
-    uint32_t numberVoltageSwellsL3;
-    String textMessage;
-    FixedValue instantaneousVoltageL1;
-    FixedValue instantaneousVoltageL2;
-    FixedValue instantaneousVoltageL3;
-    FixedValue instantaneousCurrentL1;
-    FixedValue instantaneousCurrentL2;
-    FixedValue instantaneousCurrentL3;
-    FixedValue activePowerL1P;
-    FixedValue activePowerL2P;
-    FixedValue activePowerL3P;
-    FixedValue activePowerL1NP;
-    FixedValue activePowerL2NP;
-    FixedValue activePowerL3NP;
-    FixedValue actualElectricityPowerDeli;
-    FixedValue actualElectricityPowerRet;
-  } DataReaded = {};
-  void OnNewDatagram(std::function<void()> callback)
-  {
-    delegates.push_back(callback);
+    uint32_t sequence = 0;         // number of the datagram, +1 on each one published
+    unsigned long captureTime = 0; // millis() when the datagram was complete
+    uint32_t epoch = 0;            // P1timestamp in UTC, seconds since 1970 (0 = not received)
+    int16_t utcOffset = 0;         // local time of the meter - UTC, seconds (summer time included)
+    uint64_t changed = 0;          // values different from the previous datagram, see Field
+
+    /// @brief The value is different from the one of the previous datagram (always true for the first one)
+    bool HasChanged(uint8_t field) const
+    {
+      return (changed >> field) & 1;
+    }
+
+    P1_FIELDS(P1_FIELD_STORAGE)
+  };
+
+  /// @brief Largest value of DataP1, copied before the update of a field to detect a change
+  static constexpr size_t MaxFieldSize = std::max({P1_FIELDS(P1_FIELD_SIZEOF) size_t(0)});
+
+  /// @brief Last complete datagram. It is never modified while the next one is parsed
+  const DataP1 &GetSnapshot() const
+  {
+    return buffers[frontBuffer];
+  }
+
+  /// @brief Particularities of a meter model, see MeterProfile
+  enum MeterFlag : uint8_t
+  {
+    MeterInverseTariff = 1, // tariff 1 is the day tariff (Belgium) : swapped to keep tariff 1 = low, as the Dutch meters and Domoticz
+    MeterGasNextLine = 2,   // DSMR 2.2/3 : the gas comes as 0-n:24.3.0 with its value on the next line
+  };
+
+  /// @brief Meter model, selected by the start of the header line (after the '/').
+  /// No list of the expected OBIS codes : the same model sends other lines depending on the country and the firmware
+  /// (a Sagemcom T210-D sends the capacity tariff in Belgium, not in the Netherlands), a line not listed would be lost.
+  /// An unknown line costs a binary search in the OBIS table (7 steps), it is skipped as soon as its reference is read.
+  struct MeterProfile
+  {
+    PGM_P prefix;
+    PGM_P name;
+    uint8_t flags; // MeterFlag
+  };
+
+  /// @brief How the value of an OBIS line is decoded
+  enum class OBISType : uint8_t
+  {
+    Ignore,  // known line, not used
+    Text,    // first parenthesis as text, leading zeros removed
+    HexText, // first parenthesis as hexadecimal text, decoded (truncated to the size of the field)
+    UInt,    // first parenthesis as integer
+    Fixed,   // value before the unit ('*') as FixedValue (milli-units)
+    Tariff,  // tariff indicator, swapped with the tariffs (see inverseTariff)
+    Timed,   // capture time (first parenthesis, in the alt field) and FixedValue (second parenthesis) : M-Bus, 1-0:1.6.0
+    TimedNextLine, // DSMR 2.2/3 gas (0-n:24.3.0) : capture time as Timed, the FixedValue alone on the next line
+    Capture, // capture time of a Timed field, written by the line of that field
+    Peaks,   // 0-0:98.1.0 : list of (start of the month)(time)(value), see PeakList
+    Failures // 1-0:99.97.0 : (count)(0-0:96.7.19) then (end)(duration*s) for each failure, merged in a PowerFailureLog
+  };
+
+  /// @brief One row of the OBIS dispatch table
+  struct OBISEntry
+  {
+    uint64_t key;       // see OBISKey()
+    OBISType type;
+    uint8_t size;       // size of the destination
+    uint16_t offset;    // destination in DataP1
+    uint16_t offsetAlt; // destination if inverseTariff
+    uint8_t field;      // see Field
+    uint8_t fieldAlt;   // Field of offsetAlt
+  };
+
+  /// @brief Description of a value of DataP1, from P1_FIELDS (strings in PROGMEM, "" = not sent)
+  struct FieldInfo
+  {
+    PGM_P name;
+    PGM_P mqtt;
+    PGM_P jsonGroup;
+    PGM_P json;
+    PGM_P unit;
+    uint64_t obis;
+    OBISType type;
+    uint8_t domoticz;
+    uint16_t offset;
+  };
+
+  /// @brief Description of a value
+  /// @param field see Field (0 to Field::Count - 1)
+  static FieldInfo GetFieldInfo(uint8_t field);
+
+  /// @brief Write a value as text (FixedValue with three decimals)
+  /// @return length written, the buffer is always null terminated
+  static size_t FieldToChars(const DataP1 &data, const FieldInfo &info, char *buffer, size_t size);
+
+  /// @brief Text of a Text, HexText or Capture value, in place in data (no copy)
+  /// @return nullptr for the other types : numbers and JSON arrays, see FieldToChars()
+  static const char *FieldText(const DataP1 &data, const FieldInfo &info);
+
+  /// @brief Write an OBIS reference as text, ex: 1-0:1.8.1
+  static size_t OBISToChars(uint64_t key, char *buffer, size_t size);
+
+  /// @brief Same field of another M-Bus channel, ex: MBusField(2, Field::mbus1Value) = Field::mbus2Value
+  /// @param channel 1 to P1MBUSCHANNELS
+  /// @param field field of the channel 1
+  static constexpr uint8_t MBusField(uint8_t channel, uint8_t field)
+  {
+    return field + (channel - 1) * (Field::mbus2Type - Field::mbus1Type);
+  }
+
+  /// @brief The meter sent a reading for this M-Bus channel
+  static bool MBusPresent(const DataP1 &data, uint8_t channel);
+
+  /// @brief The value was received : false for the fields of an M-Bus channel without device
+  static bool FieldPresent(const DataP1 &data, const FieldInfo &info);
+
+  /// @brief Restore the log of the power failures (saved before a reboot) before the first datagram
+  void RestorePowerFailures(const PowerFailureLog &log)
+  {
+    buffers[0].longPowerFailuresLog = log;
+    buffers[1].longPowerFailuresLog = log;
+  }
+
+  /// @brief Channel of the gas meter : the first one of type MBUS_DEVICE_GAS, the channel 1 if the meter does not send the types
+  /// @return 1 to P1MBUSCHANNELS, 0 if none
+  static uint8_t GasChannel(const DataP1 &data);
+
+  /// @brief Register a consumer of the new datagrams
+  /// @param callback called when a datagram is decoded, with the fields changed since its previous call (see Field) :
+  /// the changes of the datagrams skipped by the decimation are included
+  /// @param decimation the consumer gets only 1 datagram out of N (1 = all)
+  /// @param refresh the consumer sends only the changed values (MQTT, Domoticz) : it gets AllFields for a full report,
+  /// see fullReportDue()
+  /// @return id of the consumer, see RequestFullReport()
+  uint8_t OnNewDatagram(std::function<void(uint64_t changed)> callback, unsigned int decimation = 1, bool refresh = false)
+  {
+    delegates.push_back({callback, std::max(1U, decimation), 0, 0, refresh, true, 0});
+    return delegates.size() - 1;
+  }
+
+  /// @brief The next call of the consumer gets AllFields (ex: the broker may have lost the retained topics)
+  void RequestFullReport(uint8_t consumer)
+  {
+    delegates[consumer].fullNeeded = true;
   }
 
 protected:
   void TriggerCallbacks()
   {
-    for(const auto& callback : delegates) 
+    for(auto& delegate : delegates) 
     {
-      if(callback) callback();
+      delegate.changed |= GetSnapshot().changed;
+      if (++delegate.skipped < delegate.decimation)
+      {
+        continue;
+      }
+      delegate.skipped = 0;
+      if (delegate.refresh && fullReportDue(delegate))
+      {
+        delegate.changed = AllFields;
+      }
+      if(delegate.callback) delegate.callback(delegate.changed);
+      delegate.changed = 0;
     }
   }
 private:
-  std::vector<std::function<void()>> delegates;
+  DataP1 buffers[2] = {}; // front : published snapshot, back : datagram in progress
+  uint8_t frontBuffer = 0;
+  DataP1 &BackBuffer()
+  {
+    return buffers[frontBuffer ^ 1];
+  }
+  struct Delegate
+  {
+    std::function<void(uint64_t changed)> callback;
+    unsigned int decimation;
+    unsigned int skipped;
+    uint64_t changed; // fields changed in the datagrams since the last call
+    bool refresh;     // full report from time to time, see fullReportDue()
+    bool fullNeeded;  // first call or RequestFullReport()
+    unsigned long lastFull;
+  };
+  std::vector<Delegate> delegates;
+  /// @brief All the values are sent without conf.sendOnlyChanged, at the first call, on RequestFullReport()
+  /// and every conf.fullRefresh seconds
+  bool fullReportDue(Delegate &delegate);
   settings &conf;
   unsigned long nextUpdateTime = millis() + 5000; //wait 5s before read datagram
   unsigned long TimeOutRead;
+  bool meterAverage = false;       // the datagram in progress has the quarter-hour average of the meter (1-0:1.4.0)
+  uint32_t capacityQuarter = 0;    // quarter of the last datagram : epoch / 900, 0 = none
+  uint32_t capacityQuarterTime = 0; // start of this quarter in local time, YYMMDDhhmm as a decimal number
+  int64_t quarterStartEnergy = -1; // imported energy (Wh) at the start of the quarter, -1 = unknown
+  int64_t quarterAverage = -1;     // average power (W) of the quarter so far, -1 = unknown
+  P1History history;                 // datagrams as received, from the '/' to the CRC
+  // line longer than the buffer, decoded in parts
+  bool lineContinued = false;        // the line in telegram[] is the rest of a line already partly decoded
+  OBISEntry lineEntry;               // entry of the line
+  size_t lineOffset;                 // destination of the line in DataP1 (inverseTariff applied)
+  uint8_t lineField;                 // Field of lineOffset
+  uint8_t lineGroup = 0;             // parenthesis of the line already decoded
+  PowerFailure lineFailure = {};     // failure of 1-0:99.97.0 with its end, waiting for its duration
+  uint8_t linePrevious[MaxFieldSize]; // value of the field before the line, to detect a change
+  bool valueOnNextLine = false;      // the last line was a TimedNextLine, its value is the next line
+  char timestampDate[7] = {};        // YYMMDD and S/W of the last timestamp converted
+  uint32_t timestampDay = 0;         // midnight of that date in UTC, seconds since 1970
+  P1Decryptor decryptor;             // encrypted datagrams (Smarty), enabled by conf.p1Key
   void RTS_on();
   void RTS_off();
-  void OBISparser(int len);
-  String readFirstParenthesisVal(int start, int end);
-  String readBetweenDoubleParenthesis(int start, int end);
+  int OBISparser(int len, bool lastPart);
+  void decodeLinePart();
+  void readEncrypted(int available);
+  bool readChar(int c);
+  void appendRaw(const char *text, size_t len);
+  uint64_t parseOBISReference(int len, int &pos);
+  bool findOBISEntry(uint64_t key, OBISEntry &entry);
+  void copyFirstParenthesisVal(int start, int end, char *dest, size_t size);
+  uint32_t parseTimestamp(int start, int end, int16_t &utcOffset);
+  uint32_t parseFirstParenthesisUInt(int start, int end);
+  int findSecondParenthesis(int start, int end);
+  FixedValue parseUntilStar(int start, int end);
+  void parsePeaks(int start, int end, uint8_t *dest, size_t size);
+  void parsePowerFailures(int start, int end, PowerFailureLog &log);
+  int parseHexText(int start, int end, char *dest, size_t size);
+  void UpdateCapacity(DataP1 &data);
   int FindCharInArray(const char array[], char c, int len);
+  bool CheckCRC(int endChar, int len);
   void decodeTelegram(int len);
-  String identifyMeter(String Name);
-  String readUntilStar(int start, int end);
+  void startDatagram(int startChar, int len);
+  void identifyMeter(const char *header, int len);
   bool CheckTimeout();
 };
 #endif
\ No newline at end of file
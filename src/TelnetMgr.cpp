@@ -33,10 +33,10 @@ TelnetMgr::TelnetMgr(settings &currentConf, P1Reader &currentP1) : conf(currentC
 
     if (conf.Repport2Telnet)
     {
-        P1Captor.OnNewDatagram([this]()
+        P1Captor.OnNewDatagram([this](uint64_t)
         {
             SendDataGram();
-        });
+        }, conf.telnetDecimation);
     }
 }
 
@@ -148,7 +148,24 @@ void TelnetMgr::processCommand(int clientId, const String &command)
     }
     else if (command == "raw") 
     {
-        telnetClients[clientId].println(P1Captor.datagram);
+        WiFiClient &client = telnetClients[clientId];
+        P1Captor.GetHistory().ReplayLast([&client](const char *text, size_t len)
+        {
+            client.write(text, len);
+        });
+        client.println();
+    }
+    else if (command == "history")
+    {
+        WiFiClient &client = telnetClients[clientId];
+        P1Captor.GetHistory().Replay([&client](const char *text, size_t len)
+        {
+            client.write(text, len);
+        });
+    }
+    else if (command == "data")
+    {
+        commandeData(clientId);
     }
     else if (command == "read") 
     {
@@ -165,7 +182,27 @@ void TelnetMgr::processCommand(int clientId, const String &command)
 }
 void TelnetMgr::commandeHelp(int clientId)
 {
-    telnetClients[clientId].println("Available commands: exit, raw, read, reboot, help");
+    telnetClients[clientId].println("Available commands: exit, raw, history, data, read, reboot, help");
+}
+
+void TelnetMgr::commandeData(int clientId)
+{
+    const P1Reader::DataP1 &data = P1Captor.GetSnapshot();
+    char obis[20];
+    char value[P1FIELDMAXCHARS];
+    for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+    {
+        P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+        if (!P1Reader::FieldPresent(data, info))
+        {
+            continue;
+        }
+        P1Reader::OBISToChars(info.obis, obis, sizeof(obis));
+        P1Reader::FieldToChars(data, info, value, sizeof(value));
+        telnetClients[clientId].print(FPSTR(info.name));
+        telnetClients[clientId].printf(" (%s) = %s ", obis, value);
+        telnetClients[clientId].println(FPSTR(info.unit));
+    }
 }
 
 void TelnetMgr::DoMe()
@@ -269,13 +306,15 @@ void TelnetMgr::SendDataGram()
         }
     }
 
-    int len = P1Captor.datagram.length();
-
     for (int i = 0; i < MAX_SRV_CLIENTS; i++)
     {
         if (telnetClients[i].availableForWrite() >= 1)
         {
-            telnetClients[i].write(P1Captor.datagram.c_str(), len);
+            WiFiClient &client = telnetClients[i];
+            P1Captor.GetHistory().ReplayLast([&client](const char *text, size_t len)
+            {
+                client.write(text, len);
+            });
         }
     }  
     yield();
@@ -53,6 +53,7 @@ class TelnetMgr
   void handleClientActivity();
   void processCommand(int clientId, const String &command);
   void commandeHelp(int clientId);
+  void commandeData(int clientId);
   void closeConnection(int clientId);
   public:
   explicit TelnetMgr(settings& currentConf, P1Reader &currentP1);
@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2025 Jean-Pierre Sneyers
+ * Source : https://github.com/narfight/P1-wifi-gateway
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Tests of P1Reader on the host, built by [env:native_test] : pio test -e native_test
+//
+// Each telegram of bench/corpus has its expected fields in bench/corpus/<meter>.fields, one "name=value" per line
+// (value written by FieldToChars, only the fields present in the datagram).
+// The values that the String parser of v1 already decoded come from it (equipmentId2 -> mbus1Id, gasReceived5min -> mbus1Value,
+// the Siconia with InverseHigh_1_2_Tarif), except the counters that its float rounded (123456.797) : they keep the digits of the
+// telegram. The other fields (Iskra text message, Belgian M-Bus, capacity tariff, power failure log) are read from the telegram.
+
+#include <Arduino.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "HAL.h"
+#include "P1Decryptor.h"
+#include "P1Reader.h"
+
+// ---- Firmware hooks (Main.cpp is not part of the tests) ----
+
+void MainSendDebug(const char *payload) { (void)payload; }
+void MainSendDebugPrintf(const char *format, ...) { (void)format; }
+void blink(int t, unsigned long speed) { (void)t; (void)speed; }
+
+// ---- Helpers ----
+
+/// @brief Body of a telegram of a Kaifa, from the '/' to the '!', the power delivered is given
+static std::string kaifaTelegram(const char *power)
+{
+  std::string telegram = "/KFM5KAIFA-METER\r\n\r\n"
+                         "1-3:0.2.8(42)\r\n"
+                         "0-0:1.0.0(231029141505S)\r\n"
+                         "1-0:1.8.1(000992.992*kWh)\r\n"
+                         "1-0:1.8.2(000560.157*kWh)\r\n"
+                         "1-0:1.7.0(";
+  telegram += power;
+  telegram += "*kW)\r\n"
+              "1-0:2.7.0(00.000*kW)\r\n"
+              "!";
+  return telegram;
+}
+
+/// @brief Add the CRC16 (CRC-16/ARC) of the body after the '!'
+static std::string withCRC(const std::string &body)
+{
+  uint16_t crc = 0;
+  for (unsigned char c : body)
+  {
+    crc ^= c;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  char end[8];
+  snprintf(end, sizeof(end), "%04X\r\n", crc);
+  return body + end;
+}
+
+/// @brief Give a telegram to the reader as the bench does : request, bytes in the UART, decoding.
+/// The UART buffer is emptied every 1024 bytes, as loop() does while the meter sends.
+/// @return the datagram is decoded
+static bool feed(P1Reader &reader, const std::string &telegram)
+{
+  reader.ResetnextUpdateTime();
+  HAL::advanceMillis(1);
+  reader.DoMe(); // Data Request
+  for (size_t pos = 0; pos < telegram.size(); pos += 1024)
+  {
+    HAL::feedSerial(telegram.data() + pos, std::min<size_t>(1024, telegram.size() - pos));
+    reader.DoMe(); // readTelegram -> decodeTelegram
+  }
+  return reader.dataEnd;
+}
+
+/// @brief Whole content of a file
+static bool loadFile(const std::string &path, std::string &content)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  std::ostringstream stream;
+  stream << file.rdbuf();
+  content = stream.str();
+  return true;
+}
+
+/// @brief Fields present in the snapshot, one "name=value" per line, in the order of Field
+static std::string fieldsText(const P1Reader::DataP1 &data)
+{
+  std::string text;
+  char value[P1FIELDMAXCHARS];
+  for (uint8_t field = 0; field < P1Reader::Field::Count; field++)
+  {
+    P1Reader::FieldInfo info = P1Reader::GetFieldInfo(field);
+    if (!P1Reader::FieldPresent(data, info))
+    {
+      continue;
+    }
+    P1Reader::FieldToChars(data, info, value, sizeof(value));
+    text += info.name;
+    text += '=';
+    text += value;
+    text += '\n';
+  }
+  return text;
+}
+
+/// @brief Decode the telegram of a meter of the corpus and compare its fields with the expected ones
+static void checkCorpus(const char *meter)
+{
+  std::string telegram, expected;
+  std::string path = std::string("bench/corpus/") + meter;
+  TEST_ASSERT_TRUE_MESSAGE(loadFile(path + ".txt", telegram), meter);
+  TEST_ASSERT_TRUE_MESSAGE(loadFile(path + ".fields", expected), meter);
+
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  TEST_ASSERT_TRUE_MESSAGE(feed(reader, telegram), meter);
+
+  // line by line : the message gives the first field that differs
+  std::istringstream wanted(expected), decoded(fieldsText(reader.GetSnapshot()));
+  for (;;)
+  {
+    std::string want, got;
+    bool moreWanted = static_cast<bool>(std::getline(wanted, want));
+    bool moreDecoded = static_cast<bool>(std::getline(decoded, got));
+    if (!moreWanted && !moreDecoded)
+    {
+      break;
+    }
+    std::string message = std::string(meter) + " : expected \"" + want + "\", decoded \"" + got + "\"";
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(want.c_str(), got.c_str(), message.c_str());
+  }
+}
+
+// ---- Tests ----
+
+void test_corpus_iskra() { checkCorpus("iskra"); }
+void test_corpus_kaifa() { checkCorpus("kaifa"); }
+void test_corpus_landis() { checkCorpus("landis"); }
+void test_corpus_sagemcom() { checkCorpus("sagemcom"); }
+void test_corpus_siconia() { checkCorpus("siconia"); }
+
+/// @brief Last raw datagram, as /raw and telnet give it
+static std::string lastDatagram(const P1Reader &reader)
+{
+  std::string text;
+  reader.GetHistory().ReplayLast([&text](const char *part, size_t len)
+                                 { text.append(part, len); });
+  return text;
+}
+
+/// @brief The last valid datagram stays readable while the next one is received, and after a bad CRC
+void test_raw_kept_during_reception()
+{
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.456"))));
+  std::string raw = lastDatagram(reader);
+  TEST_ASSERT_TRUE(raw.find("1-0:1.7.0(00.456*kW)") != std::string::npos);
+  TEST_ASSERT_EQUAL(raw.size(), reader.GetHistory().LastSize());
+
+  // first half of the next one
+  std::string next = withCRC(kaifaTelegram("00.789"));
+  reader.ResetnextUpdateTime();
+  HAL::advanceMillis(1);
+  reader.DoMe();
+  HAL::feedSerial(next.data(), next.size() / 2);
+  reader.DoMe();
+  TEST_ASSERT_FALSE(reader.dataEnd);
+  TEST_ASSERT_TRUE(lastDatagram(reader) == raw);
+
+  // the end with a bad CRC : dropped
+  std::string end = next.substr(next.size() / 2);
+  end[end.find('!') + 1] = (end[end.find('!') + 1] == '0') ? '1' : '0';
+  HAL::feedSerial(end.data(), end.size());
+  reader.DoMe();
+  TEST_ASSERT_TRUE(lastDatagram(reader) == raw);
+
+  TEST_ASSERT_TRUE(feed(reader, next));
+  TEST_ASSERT_TRUE(lastDatagram(reader).find("1-0:1.7.0(00.789*kW)") != std::string::npos);
+}
+
+/// @brief A datagram that grows (a text message and other lines appear) never takes the room of the last valid one before its CRC
+void test_raw_kept_when_datagram_grows()
+{
+  std::string siconia;
+  TEST_ASSERT_TRUE(loadFile("bench/corpus/siconia.txt", siconia));
+  std::string body = siconia.substr(0, siconia.find('!') + 1);
+  size_t text = body.find("0-0:96.13.0()");
+  std::string lines;
+  for (uint8_t n = 0; n < 120; n++)
+  {
+    lines += "0-0:96.13.1()\n"; // lines the module ignores
+  }
+  std::string grownValid = withCRC(body.substr(0, text) + "0-0:96.13.0(" + std::string(1024, '4') + ")\n" + lines + body.substr(text + 14));
+  std::string grown = grownValid;
+  char &digit = grown[grown.find('!') + 1];
+  digit = (digit == '0') ? '1' : '0'; // bad CRC
+
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  for (unsigned n = 0; n < 2 * P1HISTORYGROUP + 3; n++)
+  {
+    std::string telegram = body;
+    telegram.replace(telegram.find("00.350"), 6, std::to_string(10 + n % 90) + ".350");
+    TEST_ASSERT_TRUE(feed(reader, withCRC(telegram)));
+    std::string raw = lastDatagram(reader);
+
+    TEST_ASSERT_FALSE(feed(reader, grown));
+    TEST_ASSERT_TRUE(lastDatagram(reader) == raw);
+  }
+
+  // valid, but it doesn't fit beside the last one : no raw output until the next one, never an older datagram
+  TEST_ASSERT_TRUE(feed(reader, grownValid));
+  TEST_ASSERT_EQUAL(0U, reader.GetHistory().LastSize());
+  TEST_ASSERT_TRUE(feed(reader, withCRC(body)));
+  TEST_ASSERT_TRUE(lastDatagram(reader).compare(0, 5, "/FLU5") == 0);
+}
+
+/// @brief The history gives the datagrams kept as they were received, across the groups and the ring turning
+void test_history_replay()
+{
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  std::vector<std::string> raws;
+  for (unsigned n = 0; n < 20 * P1HISTORYGROUP; n++)
+  {
+    char power[8];
+    snprintf(power, sizeof(power), "%02u.%03u", n % 7, (n * 37) % 1000);
+    TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram(power))));
+    raws.push_back(lastDatagram(reader));
+    TEST_ASSERT_TRUE(raws.back().find(std::string("1-0:1.7.0(") + power + "*kW)") != std::string::npos);
+  }
+
+  const P1History &history = reader.GetHistory();
+  TEST_ASSERT_TRUE(history.Count() > P1HISTORYGROUP && history.Count() < raws.size());
+  std::string expected, replayed;
+  for (size_t n = raws.size() - history.Count(); n < raws.size(); n++)
+  {
+    expected += raws[n];
+  }
+  history.Replay([&replayed](const char *text, size_t len)
+                 { replayed.append(text, len); });
+  TEST_ASSERT_TRUE(replayed == expected);
+  TEST_ASSERT_EQUAL(expected.size(), history.ReplaySize());
+}
+
+/// @brief The longest datagram (Siconia with a text message of 1024 chars) is kept in full, the previous one
+/// stays readable while it is received
+void test_raw_long_text_message()
+{
+  std::string siconia;
+  TEST_ASSERT_TRUE(loadFile("bench/corpus/siconia.txt", siconia));
+  std::string body = siconia.substr(0, siconia.find('!') + 1);
+  size_t text = body.find("0-0:96.13.0()");
+  TEST_ASSERT_TRUE(text != std::string::npos);
+
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  std::string previous;
+  for (unsigned n = 0; n < 2 * P1HISTORYGROUP; n++)
+  {
+    std::string message(1024, '0' + n % 10);
+    std::string telegram = withCRC(body.substr(0, text) + "0-0:96.13.0(" + message + ")" + body.substr(text + 13));
+
+    // the previous one until the CRC is received
+    size_t crc = telegram.find('!');
+    reader.ResetnextUpdateTime();
+    HAL::advanceMillis(1);
+    reader.DoMe();
+    HAL::feedSerial(telegram.data(), crc);
+    reader.DoMe();
+    TEST_ASSERT_TRUE(lastDatagram(reader) == previous);
+
+    HAL::feedSerial(telegram.data() + crc, telegram.size() - crc);
+    reader.DoMe();
+    TEST_ASSERT_TRUE(reader.dataEnd);
+    previous = lastDatagram(reader);
+    TEST_ASSERT_TRUE(previous.compare(0, 5, "/FLU5") == 0);
+    TEST_ASSERT_TRUE(previous.find("0-0:96.13.0(" + message + ")") != std::string::npos);
+    TEST_ASSERT_TRUE(previous.find("0-2:24.2.1(231029141000W)(00872.234*m3)") != std::string::npos);
+  }
+}
+
+/// @brief A datagram whose end was lost is dropped when the next one starts : its values are not covered by a CRC
+void test_lost_end_dropped()
+{
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  std::string lost = "/KFM5KAIFA-METER\r\n\r\n1-0:1.8.1(999999.999*kWh)\r\n"; // the line of the '!' is lost
+  std::string valid = kaifaTelegram("00.456");
+  valid.erase(valid.find("1-0:1.8.1"), strlen("1-0:1.8.1(000992.992*kWh)\r\n"));
+
+  TEST_ASSERT_TRUE(feed(reader, lost + withCRC(valid)));
+  char value[P1FIELDMAXCHARS];
+  P1Reader::FieldToChars(reader.GetSnapshot(), P1Reader::GetFieldInfo(P1Reader::Field::electricityUsedTariff1), value, sizeof(value));
+  TEST_ASSERT_TRUE_MESSAGE(strcmp(value, "999999.999") != 0, "value of the datagram without end published");
+  TEST_ASSERT_EQUAL_UINT(1U, reader.crcErrors);
+  TEST_ASSERT_TRUE(lastDatagram(reader).find("999999.999") == std::string::npos);
+}
+
+/// @brief A consumer with a decimation must get the changes of the datagrams it skipped
+void test_decimation_keeps_skipped_changes()
+{
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  unsigned calls = 0;
+  uint64_t changed = 0;
+  reader.OnNewDatagram([&calls, &changed](uint64_t fields)
+  {
+    calls++;
+    changed = fields;
+  }, 3);
+
+  // first call : everything is new
+  for (uint8_t n = 0; n < 3; n++)
+  {
+    TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.456"))));
+  }
+  TEST_ASSERT_EQUAL_UINT(1U, calls);
+
+  // the power changes on the first datagram skipped, the one given to the consumer is the same as the previous one
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_EQUAL_UINT(2U, calls);
+  TEST_ASSERT_TRUE((changed >> P1Reader::Field::actualElectricityPowerDeli) & 1);
+  TEST_ASSERT_FALSE((changed >> P1Reader::Field::electricityUsedTariff1) & 1);
+
+  // nothing changed since the last call
+  for (uint8_t n = 0; n < 3; n++)
+  {
+    TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  }
+  TEST_ASSERT_EQUAL_UINT(3U, calls);
+  TEST_ASSERT_FALSE((changed >> P1Reader::Field::actualElectricityPowerDeli) & 1);
+}
+
+/// @brief A consumer that sends only the changed values gets all of them at its first call, on request and every fullRefresh
+void test_full_report_refresh()
+{
+  settings conf;
+  conf.interval = 10;
+  conf.sendOnlyChanged = true;
+  conf.fullRefresh = 300;
+  P1Reader reader(conf);
+  uint64_t changed = 0;
+  uint8_t consumer = reader.OnNewDatagram([&changed](uint64_t fields)
+  {
+    changed = fields;
+  }, 1, true);
+
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.456"))));
+  TEST_ASSERT_TRUE(changed == P1Reader::AllFields);
+
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_TRUE((changed >> P1Reader::Field::actualElectricityPowerDeli) & 1);
+  TEST_ASSERT_FALSE((changed >> P1Reader::Field::electricityUsedTariff1) & 1);
+
+  reader.RequestFullReport(consumer);
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_TRUE(changed == P1Reader::AllFields);
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_FALSE((changed >> P1Reader::Field::actualElectricityPowerDeli) & 1);
+
+  HAL::advanceMillis(300 * 1000UL);
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.789"))));
+  TEST_ASSERT_TRUE(changed == P1Reader::AllFields);
+}
+
+/// @brief The quarter-hour average of the meter (1-0:1.4.0) is only used for the datagrams that have it,
+/// the average computed on the module has its own field
+void test_capacity_average_per_datagram()
+{
+  std::string siconia;
+  TEST_ASSERT_TRUE(loadFile("bench/corpus/siconia.txt", siconia));
+  settings conf;
+  conf.interval = 10;
+  conf.tariffOrder = TARIFF_AUTO;
+  P1Reader reader(conf);
+  TEST_ASSERT_TRUE(feed(reader, siconia));
+  TEST_ASSERT_EQUAL(2351, reader.GetSnapshot().quarterAverageDemand.int_val());
+
+  // same quarter, a meter without 1-0:1.4.0 : computed from the import counters
+  TEST_ASSERT_TRUE(feed(reader, withCRC(kaifaTelegram("00.456"))));
+  TEST_ASSERT_EQUAL(2351, reader.GetSnapshot().currentAverageDemand.int_val());
+  TEST_ASSERT_TRUE(reader.GetSnapshot().quarterAverageDemand.int_val() != 2351);
+}
+
+/// @brief The log of the power failures is flagged as changed only when a failure is added
+void test_power_failures_changed()
+{
+  std::string landis;
+  TEST_ASSERT_TRUE(loadFile("bench/corpus/landis.txt", landis));
+  std::string body = landis.substr(0, landis.find('!') + 1);
+  settings conf;
+  conf.interval = 10;
+  P1Reader reader(conf);
+  TEST_ASSERT_TRUE(feed(reader, withCRC(body)));
+  TEST_ASSERT_TRUE(feed(reader, withCRC(body)));
+  TEST_ASSERT_FALSE((reader.GetSnapshot().changed >> P1Reader::Field::longPowerFailuresLog) & 1);
+
+  std::string failure = "(191125120000W)(0000000111*s)";
+  body.replace(body.find(failure), failure.size(), "(191126080000W)(0000000222*s)");
+  TEST_ASSERT_TRUE(feed(reader, withCRC(body)));
+  TEST_ASSERT_TRUE((reader.GetSnapshot().changed >> P1Reader::Field::longPowerFailuresLog) & 1);
+  TEST_ASSERT_EQUAL(2, reader.GetSnapshot().longPowerFailuresLog.count);
+}
+
+/// @brief Header of a Smarty frame with 4 bytes of data : 0xDB, system title, 0x82, length, security control, frame counter
+static std::vector<uint8_t> smartyHeader(uint8_t titleLength)
+{
+  std::vector<uint8_t> frame = {0xDB, titleLength, 'S', 'A', 'G', 'Y', 0x00, 0x00, 0x00, 0x01, 0x82, 0x00, 1 + 4 + 4 + P1FRAMETAG, 0x30, 0x00, 0x00, 0x00, 0x01};
+  return frame;
+}
+
+/// @brief A header that is not an encrypted datagram is a framing error, only a tag not valid points to the key
+void test_decryptor_errors()
+{
+  P1Decryptor decryptor;
+  TEST_ASSERT_TRUE(decryptor.Begin("000102030405060708090A0B0C0D0E0F"));
+
+  std::vector<uint8_t> frame = smartyHeader(7);
+  TEST_ASSERT_EQUAL(P1FRAMEHEADER, frame.size());
+  TEST_ASSERT_EQUAL(P1FRAMEERROR, decryptor.Decrypt(frame.data(), frame.size()));
+
+  decryptor.Reset();
+  frame = smartyHeader(8);
+  TEST_ASSERT_EQUAL(0, decryptor.Decrypt(frame.data(), frame.size()));
+  uint8_t data[4] = {'/', 'S', 'A', 'G'};
+  TEST_ASSERT_EQUAL(3, decryptor.Decrypt(data, sizeof(data)));
+  uint8_t tag[P1FRAMETAG] = {};
+  TEST_ASSERT_EQUAL(P1TAGERROR, decryptor.Decrypt(tag, sizeof(tag)));
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_corpus_iskra);
+  RUN_TEST(test_corpus_kaifa);
+  RUN_TEST(test_corpus_landis);
+  RUN_TEST(test_corpus_sagemcom);
+  RUN_TEST(test_corpus_siconia);
+  RUN_TEST(test_decimation_keeps_skipped_changes);
+  RUN_TEST(test_full_report_refresh);
+  RUN_TEST(test_capacity_average_per_datagram);
+  RUN_TEST(test_power_failures_changed);
+  RUN_TEST(test_decryptor_errors);
+  RUN_TEST(test_lost_end_dropped);
+  RUN_TEST(test_raw_kept_during_reception);
+  RUN_TEST(test_raw_long_text_message);
+  RUN_TEST(test_raw_kept_when_datagram_grows);
+  RUN_TEST(test_history_replay);
+  return UNITY_END();
+}